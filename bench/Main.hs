@@ -0,0 +1,82 @@
+{-|
+Module      : Main
+Description : Benchmarks for the generated pool runtimes
+Copyright   : (c) Zebulun Arendsee, 2021
+License     : GPL-3
+Maintainer  : zbwrnz@gmail.com
+Stability   : experimental
+
+The C++ serialization runtime is stored as text in the morloc library and is
+included by every generated pool. Here it is written to a temporary folder,
+compiled against small C++ drivers, and timed:
+
+ * @deserialize-scaling@ parses FASTA-like payloads of increasing size, to
+   check that parsing is linear in the input size. It fails if the time per
+   byte of the largest payload is more than 'maxRatio' times that of the
+   smallest.
+
+ * @serial-throughput@ serializes and deserializes lists of booleans,
+   integers, reals, strings, nested lists, tuples and a generated record in
+   both wire formats, and compares the times to those stored in
+   @bench/serial-baseline.txt@. It fails if any time is more than
+   'tolerance' times its baseline. Its output is a new baseline.
+
+The test suite runs the throughput suite at small sizes to check that every
+payload survives a round trip, and compares its times to the baseline only
+when MORLOC_TEST_TIMING is set.
+-}
+
+import qualified Morloc.CodeGenerator.Grammars.Translator.Source.CppInternals as Src
+import qualified Morloc.CodeGenerator.Grammars.Translator.Cpp as Cpp
+import qualified Morloc.Data.Doc as Doc
+import qualified Data.Text.IO as TIO
+import qualified System.Directory as SD
+import qualified System.Environment as SE
+import qualified System.Process as SP
+
+-- | Payload sizes in bytes of the scaling run, from 1KB to 1GB, and of the
+-- throughput suite, from 10B to 300MB. The largest size of both can be lowered
+-- by passing a maximum size (in bytes) as the first argument.
+scalingSizes, throughputSizes :: [Integer]
+scalingSizes = [10 ^ i | i <- [3 .. 9 :: Integer]]
+throughputSizes = [10 ^ i | i <- [1 .. 8 :: Integer]] ++ [3 * 10 ^ (8 :: Integer)]
+
+-- | How much slower per byte the largest scaling payload may be than the
+-- smallest
+maxRatio :: Double
+maxRatio = 3
+
+-- | How much slower than its baseline a case may be
+tolerance :: Double
+tolerance = 2
+
+main :: IO ()
+main = do
+  args <- SE.getArgs
+  let upTo = case args of
+        (x:_) -> takeWhile (<= read x)
+        [] -> id
+  wd <- SD.getCurrentDirectory >>= SD.makeAbsolute
+  tmp <- SD.getTemporaryDirectory
+  let dir = tmp ++ "/morloc-bench"
+  SD.createDirectoryIfMissing True dir
+  TIO.writeFile (dir ++ "/serial.hpp") (Doc.render Src.serializationHandling)
+  TIO.writeFile (dir ++ "/record.hpp") (Doc.render Cpp.benchRecord)
+  scaling <- compile dir wd "deserialize-scaling"
+  throughput <- compile dir wd "serial-throughput"
+  putStrLn "C++ deserialization of [(Str,Str)] - bytes, seconds, ns/byte"
+  SP.callProcess scaling $
+    ["--max-ratio", show maxRatio] ++ map show (upTo scalingSizes)
+  putStrLn "C++ serialization throughput"
+  SP.callProcess throughput $
+    [ "--baseline", wd ++ "/bench/serial-baseline.txt"
+    , "--tolerance", show tolerance
+    ] ++ map show (upTo throughputSizes)
+
+-- | Compile a driver from bench/cpp and return the path of the executable
+compile :: FilePath -> FilePath -> String -> IO FilePath
+compile dir wd name = do
+  let exe = dir ++ "/" ++ name
+  SP.callProcess "g++"
+    ["--std=c++11", "-O2", "-I" ++ dir, "-o", exe, wd ++ "/bench/cpp/" ++ name ++ ".cpp"]
+  return exe
@@ -0,0 +1,76 @@
+// Time deserialization of FASTA-like payloads of increasing size. Each
+// argument is a payload size in bytes. For each size, one line is printed:
+//
+//   <bytes> <seconds per parse> <nanoseconds per byte>
+//
+// If parsing is linear in the input size, the last column is constant. The
+// program fails if the nanoseconds per byte of the largest payload are more
+// than `--max-ratio` (3 by default) times those of the smallest.
+
+#include <chrono>
+#include <cstdlib>
+#define MORLOC_RUNTIME_IMPLEMENTATION
+#include "serial.hpp"
+
+// a list of (header, sequence) pairs that is roughly `bytes` long
+std::string make_fasta_json(size_t bytes){
+    const std::string seq(100, 'A');
+    std::string json;
+    json.reserve(bytes + 256);
+    json += "[";
+    for(size_t i = 0; json.size() < bytes; i++){
+        if(i > 0){
+            json += ",";
+        }
+        json += "[\"seq" + std::to_string(i) + "\",\"" + seq + "\"]";
+    }
+    json += "]";
+    return json;
+}
+
+int main(int argc, char * argv[])
+{
+    double max_ratio = 3;
+    // the nanoseconds per byte of the smallest and largest payloads
+    size_t smallest = 0, largest = 0;
+    double smallest_ns = 0, largest_ns = 0;
+    for(int arg = 1; arg < argc; arg++){
+        if(std::string(argv[arg]) == "--max-ratio" && arg + 1 < argc){
+            max_ratio = std::strtod(argv[++arg], NULL);
+            continue;
+        }
+        size_t bytes = std::strtoull(argv[arg], NULL, 10);
+        std::string json = make_fasta_json(bytes);
+        // repeat small inputs so every size runs for a measurable time
+        size_t reps = std::max((size_t)1, (size_t)100000000 / json.size());
+        std::vector<std::tuple<std::string,std::string>> schema;
+        size_t entries = 0;
+        auto start = std::chrono::steady_clock::now();
+        for(size_t r = 0; r < reps; r++){
+            entries += deserialize(json, schema).size();
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(stop - start).count() / reps;
+        if(entries == 0){
+            std::cerr << "Failed to parse payload of size " << json.size() << std::endl;
+            return 1;
+        }
+        double ns = 1e9 * seconds / json.size();
+        std::cout << json.size() << " " << seconds << " " << ns << std::endl;
+        if(smallest == 0 || json.size() < smallest){
+            smallest = json.size();
+            smallest_ns = ns;
+        }
+        if(json.size() > largest){
+            largest = json.size();
+            largest_ns = ns;
+        }
+    }
+    if(largest_ns > max_ratio * smallest_ns){
+        std::cerr << "Parsing " << largest << " bytes took " << largest_ns / smallest_ns
+                  << " times as long per byte as parsing " << smallest << " bytes, more than "
+                  << max_ratio << std::endl;
+        return 1;
+    }
+    return 0;
+}
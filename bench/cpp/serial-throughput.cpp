@@ -0,0 +1,200 @@
+// Time the C++ serializers on lists of each kind of value that pools pass,
+// in both wire formats. Each argument is a payload size in bytes of the JSON
+// form. For each case, wire format and size, one line is printed:
+//
+//   <case> <wire> <size> <serialize ns/byte> <deserialize ns/byte>
+//
+// where a byte is a byte of the encoded data. The output can be stored as a
+// baseline. Given a baseline with --baseline, two more columns give the ratio
+// of each time to the baseline time, and the program fails if any ratio is
+// above the tolerance given with --tolerance. Every payload is also checked to
+// survive a round trip.
+//
+// The record type is written by the benchmark driver to "record.hpp" with the
+// code generator's own struct and serializer templates.
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#define MORLOC_RUNTIME_IMPLEMENTATION
+#include "serial.hpp"
+#include "record.hpp"
+
+// the serialized size of the payloads that are timed, summed over all the
+// repeats of one measurement
+static size_t budget = 100000000;
+
+// the best of several measurements is taken, the others are slowed by
+// whatever else the machine is doing
+static const int rounds = 3;
+
+static double tolerance = 2;
+
+// the times of a baseline, by case, wire format and size
+static std::map<std::string, std::pair<double,double>> baseline;
+
+static bool failed = false;
+
+// written to so the timed calls are not optimized away
+static volatile size_t sink = 0;
+
+// every string has characters that JSON escapes and one that is not ASCII
+std::string string_value(size_t i){
+    return "name \"" + std::to_string(i) + "\"\tcaf\xc3\xa9\\\n";
+}
+
+bool make_bool(size_t i){
+    return i % 3 == 0;
+}
+
+int make_int(size_t i){
+    return (int)((i * 7919) % 1000003) - 500000;
+}
+
+double make_double(size_t i){
+    return make_int(i) / 7.0;
+}
+
+std::vector<int> make_vector(size_t i){
+    std::vector<int> xs(16);
+    for(size_t j = 0; j < xs.size(); j++){
+        xs[j] = make_int(i * 16 + j);
+    }
+    return xs;
+}
+
+std::tuple<std::string,int,double> make_tuple(size_t i){
+    return std::make_tuple(string_value(i), make_int(i), make_double(i));
+}
+
+bench_record make_record(size_t i){
+    bench_record x;
+    x.name = string_value(i);
+    x.count = make_int(i);
+    x.score = make_double(i);
+    x.tags = {"a", string_value(i + 1)};
+    x.valid = make_bool(i);
+    return x;
+}
+
+template <class A>
+std::vector<A> make_list(A (*make)(size_t), size_t n){
+    std::vector<A> xs;
+    xs.reserve(n);
+    for(size_t i = 0; i < n; i++){
+        xs.push_back(make(i));
+    }
+    return xs;
+}
+
+// nanoseconds of one call of f
+template <class F>
+double best_time(F f, size_t reps){
+    double best = 0;
+    for(int r = 0; r < rounds; r++){
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < reps; i++){
+            sink += f();
+        }
+        auto stop = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(stop - start).count() / reps;
+        if(r == 0 || ns < best){
+            best = ns;
+        }
+    }
+    return best;
+}
+
+template <class A>
+void run_case(const char* name, A (*make)(size_t), const std::vector<size_t> &sizes){
+    // the number of elements in a payload of each size is estimated from the
+    // JSON size of a sample
+    const size_t sample = 256;
+    double bytes_per_element = (double)serialize(make_list(make, sample)).size() / sample;
+    for(size_t size : sizes){
+        size_t n = std::max((size_t)1, (size_t)(size / bytes_per_element));
+        std::vector<A> xs = make_list(make, n);
+        for(morloc_wire_t wire : {MORLOC_WIRE_JSON, MORLOC_WIRE_BINARY}){
+            const char* wire_name = wire == MORLOC_WIRE_JSON ? "json" : "binary";
+            std::string data = serialize(xs, xs, wire);
+            // the same type is re-serialized since records do not define ==
+            if(serialize(deserialize(data, xs), xs, wire) != data){
+                std::cerr << name << " " << wire_name << " " << size << ": round trip failed" << std::endl;
+                failed = true;
+                continue;
+            }
+            size_t reps = std::max((size_t)1, budget / data.size());
+            double ser = best_time([&](){ return serialize(xs, xs, wire).size(); }, reps) / data.size();
+            double des = best_time([&](){ return deserialize(data, xs).size(); }, reps) / data.size();
+
+            std::ostringstream key;
+            key << name << " " << wire_name << " " << size;
+            std::cout << key.str() << " " << ser << " " << des;
+            auto base = baseline.find(key.str());
+            if(base != baseline.end()){
+                double ser_ratio = ser / base->second.first;
+                double des_ratio = des / base->second.second;
+                std::cout << " " << ser_ratio << " " << des_ratio;
+                if(ser_ratio > tolerance || des_ratio > tolerance){
+                    std::cerr << key.str() << ": slower than the baseline, serialize x"
+                              << ser_ratio << ", deserialize x" << des_ratio << std::endl;
+                    failed = true;
+                }
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+bool read_baseline(const char* filename){
+    std::ifstream file(filename);
+    if(!file){
+        return false;
+    }
+    std::string line;
+    while(std::getline(file, line)){
+        if(line.empty() || line[0] == '#'){
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name, wire, size;
+        double ser, des;
+        if(fields >> name >> wire >> size >> ser >> des){
+            baseline[name + " " + wire + " " + size] = std::make_pair(ser, des);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    std::vector<size_t> sizes;
+    for(int arg = 1; arg < argc; arg++){
+        std::string opt = argv[arg];
+        if(opt == "--budget" && arg + 1 < argc){
+            budget = std::strtoull(argv[++arg], NULL, 10);
+        } else if(opt == "--tolerance" && arg + 1 < argc){
+            tolerance = std::strtod(argv[++arg], NULL);
+        } else if(opt == "--baseline" && arg + 1 < argc){
+            if(!read_baseline(argv[++arg])){
+                std::cerr << "Cannot read baseline " << argv[arg] << std::endl;
+                return 1;
+            }
+        } else {
+            sizes.push_back(std::strtoull(argv[arg], NULL, 10));
+        }
+    }
+
+    std::cout << "# case wire size serialize(ns/byte) deserialize(ns/byte)";
+    std::cout << (baseline.empty() ? "" : " serialize/baseline deserialize/baseline") << std::endl;
+    run_case("bool", make_bool, sizes);
+    run_case("int", make_int, sizes);
+    run_case("double", make_double, sizes);
+    run_case("string", string_value, sizes);
+    run_case("vector", make_vector, sizes);
+    run_case("tuple", make_tuple, sizes);
+    run_case("record", make_record, sizes);
+
+    return failed ? 1 : 0;
+}
@@ -19,6 +19,8 @@ import qualified Morloc.Data.Doc as Doc
 import qualified Morloc.Module as Mod
 import qualified Morloc.Monad as MM
 import qualified Morloc.Frontend.API as F
+import qualified Morloc.ProgramBuilder.Calibrate as Calibrate
+import Morloc.ProgramBuilder.Bench (BenchPlan(..))
 import Text.Megaparsec.Error (errorBundlePretty)
 
 
@@ -30,6 +32,8 @@ runMorloc args = do
     (CmdMake g) -> cmdMake g verbose config
     (CmdInstall g) -> cmdInstall g verbose config
     (CmdTypecheck g) -> cmdTypecheck g verbose config
+    (CmdCalibrate g) -> cmdCalibrate verbose config
+    (CmdBench g) -> cmdBench g verbose config
     
 
 -- | read the global morloc config file or return a default one
@@ -37,6 +41,8 @@ getConfig :: CliCommand -> IO Config.Config
 getConfig (CmdMake g) = getConfig' (makeConfig g) (makeVanilla g)
 getConfig (CmdInstall g) = getConfig' (installConfig g) (installVanilla g)
 getConfig (CmdTypecheck g) = getConfig' (typecheckConfig g) (typecheckVanilla g)
+getConfig (CmdCalibrate g) = getConfig' (calibrateConfig g) (calibrateVanilla g)
+getConfig (CmdBench g) = getConfig (CmdMake (benchMake g))
 
 getConfig' :: String -> Bool -> IO Config.Config
 getConfig' _ True = Config.loadMorlocConfig Nothing
@@ -47,6 +53,8 @@ getVerbosity :: CliCommand -> Int
 getVerbosity (CmdMake      g) = if makeVerbose      g then 1 else 0
 getVerbosity (CmdInstall   g) = if installVerbose   g then 1 else 0
 getVerbosity (CmdTypecheck g) = if typecheckVerbose g then 1 else 0
+getVerbosity (CmdCalibrate g) = if calibrateVerbose g then 1 else 0
+getVerbosity (CmdBench     g) = getVerbosity (CmdMake (benchMake g))
 
 readScript :: Bool -> String -> IO (Maybe Path, Code)
 readScript True code = return (Nothing, Code (MT.pack code))
@@ -73,9 +81,65 @@ cmdMake args verbosity config = do
   outfile <- case makeOutfile args of
     "" -> return Nothing
     x -> return . Just . Path . MT.pack $ x
-  MM.runMorlocMonad outfile verbosity config (M.writeProgram path code) >>=
+  config' <- withMakeOptions args config
+  MM.runMorlocMonad outfile verbosity config' (M.writeProgram path code) >>=
     MM.writeMorlocReturn
 
+-- | override config settings with the options given to @morloc make@
+withMakeOptions :: MakeCommand -> Config.Config -> IO Config.Config
+withMakeOptions args config = do
+  wire <- case makeWireFormat args of
+    "" -> return (configWireFormat config)
+    x -> case Config.readWireFormat (MT.pack x) of
+      (Just wire) -> return wire
+      Nothing -> fail $ "Unknown wire format '" <> x <> "', expected 'json' or 'binary'"
+  nexus <- case makeNexus args of
+    "" -> return (configNexus config)
+    x -> case Config.readNexusBackend (MT.pack x) of
+      (Just nexus) -> return nexus
+      Nothing -> fail $ "Unknown nexus '" <> x <> "', expected 'perl' or 'cpp'"
+  buildProfile <- case makeBuildProfile args of
+    "" -> return (configBuildProfile config)
+    x -> case Config.readBuildProfile (MT.pack x) of
+      (Just profile) -> return profile
+      Nothing -> fail $ "Unknown build profile '" <> x <> "', expected 'debug', 'release', 'native' or 'pgo'"
+  return $ config
+    { configWireFormat = wire
+    , configPoolDaemons = configPoolDaemons config || makePoolDaemons args
+    , configPoolThreads = if makeThreads args > 0 then makeThreads args else configPoolThreads config
+    , configNexus = nexus
+    , configResultCache = if makeCache args > 0 then makeCache args else configResultCache config
+    , configProfile = if null (makeProfile args) then configProfile config else Just (Path (MT.pack (makeProfile args)))
+    , configBuildProfile = buildProfile
+    , configTrainCommand = if null (makeTrain args) then configTrainCommand config else Just (MT.pack (makeTrain args))
+    }
+
+-- | build a Morloc program and time its exported commands
+cmdBench :: BenchCommand -> Int -> Config.Config -> IO ()
+cmdBench args verbosity config = do
+  let make = benchMake args
+  (path, code) <- readScript (makeExpression make) (makeScript make)
+  outfile <- case makeOutfile make of
+    "" -> return Nothing
+    x -> return . Just . Path . MT.pack $ x
+  config' <- withMakeOptions make config
+  when (benchRuns args < 1) $ fail "At least one timed run is needed, --runs must be positive"
+  let plan = BenchPlan
+        { planCalls = map (MT.words . MT.pack) (benchCalls args)
+        , planCommands = map (EVar . MT.pack) (benchCommands args)
+        , planSize = benchSize args
+        , planRuns = benchRuns args
+        , planWarmup = benchWarmup args
+        , planJson = Path (MT.pack (benchJson args))
+        }
+  MM.runMorlocMonad outfile verbosity config' (M.benchProgram path code plan) >>=
+    MM.writeMorlocReturn
+
+-- | measure call costs on this machine for the realize step to use
+cmdCalibrate :: Int -> Config.Config -> IO ()
+cmdCalibrate verbosity config =
+  MM.runMorlocMonad Nothing verbosity config Calibrate.calibrate >>= MM.writeMorlocReturn
+
 -- | run the typechecker on a module but do not build it
 cmdTypecheck :: TypecheckCommand -> Int -> Config.Config -> IO ()
 cmdTypecheck args verbosity config = do
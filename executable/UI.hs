@@ -4,6 +4,8 @@ module UI (
   , MakeCommand(..)
   , InstallCommand(..)
   , TypecheckCommand(..)
+  , CalibrateCommand(..)
+  , BenchCommand(..)
 ) where
 
 import Options.Applicative
@@ -20,12 +22,16 @@ data CliCommand
   = CmdMake MakeCommand
   | CmdInstall InstallCommand
   | CmdTypecheck TypecheckCommand
+  | CmdCalibrate CalibrateCommand
+  | CmdBench BenchCommand
 
 cliParser :: Parser CliCommand
 cliParser = hsubparser
   ( makeSubcommand
   <> installSubcommand
   <> typecheckSubcommand
+  <> calibrateSubcommand
+  <> benchSubcommand
   )
 
 
@@ -35,6 +41,14 @@ data MakeCommand = MakeCommand
   , makeVerbose :: Bool
   , makeVanilla :: Bool
   , makeOutfile :: String
+  , makeWireFormat :: String
+  , makePoolDaemons :: Bool
+  , makeThreads :: Int
+  , makeNexus :: String
+  , makeCache :: Int
+  , makeProfile :: String
+  , makeBuildProfile :: String
+  , makeTrain :: String
   , makeScript :: String
   }
 
@@ -45,6 +59,14 @@ makeCommandParser = MakeCommand
   <*> optVerbose
   <*> optVanilla
   <*> optOutfile
+  <*> optWireFormat
+  <*> optPoolDaemons
+  <*> optThreads
+  <*> optNexus
+  <*> optCache
+  <*> optProfile
+  <*> optBuildProfile
+  <*> optTrain
   <*> optScript
 
 makeSubcommand :: Mod CommandFields CliCommand
@@ -96,6 +118,48 @@ typecheckSubcommand =
   command "typecheck" (info (CmdTypecheck <$> makeTypecheckParser) (progDesc "typecheck a morloc program"))
 
 
+data CalibrateCommand = CalibrateCommand
+  { calibrateConfig :: String
+  , calibrateVanilla :: Bool
+  , calibrateVerbose :: Bool
+  }
+
+makeCalibrateParser :: Parser CalibrateCommand
+makeCalibrateParser = CalibrateCommand
+  <$> optConfig
+  <*> optVanilla
+  <*> optVerbose
+
+calibrateSubcommand :: Mod CommandFields CliCommand
+calibrateSubcommand =
+  command "calibrate" (info (CmdCalibrate <$> makeCalibrateParser) (progDesc "measure the cost of calls in each installed language"))
+
+
+data BenchCommand = BenchCommand
+  { benchMake :: MakeCommand
+  , benchCalls :: [String]
+  , benchCommands :: [String]
+  , benchSize :: Int
+  , benchRuns :: Int
+  , benchWarmup :: Int
+  , benchJson :: String
+  }
+
+makeBenchParser :: Parser BenchCommand
+makeBenchParser = BenchCommand
+  <$> makeCommandParser
+  <*> optCalls
+  <*> optCommands
+  <*> optSize
+  <*> optRuns
+  <*> optWarmup
+  <*> optJson
+
+benchSubcommand :: Mod CommandFields CliCommand
+benchSubcommand =
+  command "bench" (info (CmdBench <$> makeBenchParser) (progDesc "build a morloc script and time its exported commands"))
+
+
 optExpression :: Parser Bool
 optExpression = switch
   ( long "expression"
@@ -146,6 +210,119 @@ optOutfile = strOption
   <> help "the name of the generated executable"
   )
 
+optWireFormat :: Parser String
+optWireFormat = strOption
+  ( long "wire-format"
+  <> metavar "FORMAT"
+  <> value ""
+  <> help "encoding for data passed between pools, either 'json' or 'binary' (overrides the config)"
+  )
+
+optPoolDaemons :: Parser Bool
+optPoolDaemons = switch
+  ( long "pool-daemons"
+  <> help "keep pools running as daemons for the length of a nexus call (overrides the config)"
+  )
+
+optThreads :: Parser Int
+optThreads = option auto
+  ( long "threads"
+  <> metavar "N"
+  <> value 0
+  <> help "maximum number of foreign calls a C++ manifold runs at once, 1 runs them in order (overrides the config)"
+  )
+
+optNexus :: Parser String
+optNexus = strOption
+  ( long "nexus"
+  <> metavar "BACKEND"
+  <> value ""
+  <> help "the generated user interface, either 'perl' or a compiled 'cpp' program (overrides the config)"
+  )
+
+optCache :: Parser Int
+optCache = option auto
+  ( long "cache"
+  <> metavar "MB"
+  <> value 0
+  <> help "cache pool results on disk under the tmpdir, keeping at most MB megabytes (overrides the config)"
+  )
+
+optProfile :: Parser String
+optProfile = strOption
+  ( long "profile"
+  <> metavar "FILE"
+  <> value ""
+  <> help "choose between instances by the run times a program recorded in FILE when run with MORLOC_PROFILE=FILE (overrides the config)"
+  )
+
+optBuildProfile :: Parser String
+optBuildProfile = strOption
+  ( long "build-profile"
+  <> metavar "NAME"
+  <> value ""
+  <> help "optimization of compiled pools: 'debug', 'release', 'native' or 'pgo' (overrides the config)"
+  )
+
+optTrain :: Parser String
+optTrain = strOption
+  ( long "train"
+  <> metavar "ARGS"
+  <> value ""
+  <> help "nexus arguments of the training run of a 'pgo' build, e.g. \"foo 1 2\" (overrides the config)"
+  )
+
+optCalls :: Parser [String]
+optCalls = many $ strOption
+  ( long "call"
+  <> metavar "ARGS"
+  <> help "nexus arguments to time, split on whitespace, e.g. \"foo 1 [2,3]\" (repeatable)"
+  )
+
+optCommands :: Parser [String]
+optCommands = many $ strOption
+  ( long "command"
+  <> short 'c'
+  <> metavar "NAME"
+  <> help "an exported command to time with arguments generated from its type (repeatable, all commands if no --call or --command is given)"
+  )
+
+optSize :: Parser Int
+optSize = option auto
+  ( long "size"
+  <> metavar "N"
+  <> value 10
+  <> showDefault
+  <> help "the length of generated lists and strings"
+  )
+
+optRuns :: Parser Int
+optRuns = option auto
+  ( long "runs"
+  <> metavar "N"
+  <> value 20
+  <> showDefault
+  <> help "timed runs of each call"
+  )
+
+optWarmup :: Parser Int
+optWarmup = option auto
+  ( long "warmup"
+  <> metavar "N"
+  <> value 2
+  <> showDefault
+  <> help "untimed runs of each call made before the timed ones"
+  )
+
+optJson :: Parser String
+optJson = strOption
+  ( long "json"
+  <> metavar "FILE"
+  <> value "bench.json"
+  <> showDefault
+  <> help "where the results are written"
+  )
+
 optScript :: Parser String
 optScript = argument str (metavar "<script>")
 
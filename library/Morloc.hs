@@ -1,5 +1,6 @@
 module Morloc
   ( writeProgram
+  , benchProgram
   , typecheck
   ) where
 
@@ -9,7 +10,8 @@ import Morloc.Frontend.Namespace (TypedDag)
 import qualified Morloc.Frontend.API as F
 import Morloc.Frontend.Desugar (desugar) 
 import Morloc.CodeGenerator.Generate (generate)
-import Morloc.ProgramBuilder.Build (buildProgram)
+import Morloc.ProgramBuilder.Build (buildProgram, nexusExecutable)
+import Morloc.ProgramBuilder.Bench (BenchPlan, bench)
 import Morloc.Frontend.Treeify (treeify)
 
 typecheck :: Maybe Path -> Code -> MorlocMonad TypedDag
@@ -39,3 +41,17 @@ writeProgram path code
   -- (Script, [Script]) -> IO ()
   -- write the code and compile as needed
   >>= buildProgram
+
+-- | Build a program as a local executable and benchmark its exported commands
+benchProgram ::
+     Maybe Path -- ^ source code filename (for debugging messages)
+  -> Code       -- ^ source code text
+  -> BenchPlan  -- ^ the calls to time
+  -> MorlocMonad ()
+benchProgram path code plan = do
+  ms <- typecheck path code >>= treeify
+  (nexus, pools) <- generate ms
+  buildProgram (nexus, pools)
+  exe <- nexusExecutable nexus
+  -- arguments are generated from the general type of each exported command
+  bench plan exe [(name, t) | SAnno _ (GMeta { metaName = Just name, metaGType = Just (GType t) }) <- ms]
@@ -19,11 +19,12 @@ types associated with any term.
 
 The @generate@ function converts the @SAnno GMeta Many [CType]@ types into
 @SAnno GMeta One CType@ unambiguous ASTs. This step is an important
-optimization step in the morloc build pipeline. Currently the compiler uses a
-flat scoring matrix for the cost of interop between languages (e.g., 0 for C++
-to C++, 1000 for anything to R, 5 for R to R since there is a function call
-cost, etc). Replacing this algorithm with an empirically parameterized
-performance model is a major goal.
+optimization step in the morloc build pipeline. The cost of interop between
+languages is measured by @morloc calibrate@, or else taken from a flat scoring
+matrix (e.g., 0 for C++ to C++, 1000 for anything to R, 5 for R to R since
+there is a function call cost, etc). The run times that a generated program
+records in a profile are added to the cost of each sourced function when the
+profile is passed to @morloc make --profile@ (see "Morloc.CostModel").
 
 Additional manipulations of the AST can reduce the number of required foreign
 calls, (de)serialization calls, and duplicate computation.
@@ -44,13 +45,14 @@ import Morloc.Data.Doc
 import Morloc.Pretty (prettyType)
 import qualified Morloc.Config as MC
 import qualified Morloc.Data.Text as MT
-import qualified Morloc.Language as Lang
+import Morloc.CostModel (CostModel, loadCostModel, interopCost, callCost)
 import qualified Morloc.Monad as MM
 import Morloc.CodeGenerator.Grammars.Common
 import qualified Morloc.CodeGenerator.Nexus as Nexus
 import qualified Morloc.Module as Mod
 import qualified Data.Map as Map
 import qualified Data.Set as Set
+import qualified Morloc.System as MS
 
 import qualified Morloc.CodeGenerator.Grammars.Translator.Cpp as Cpp
 import qualified Morloc.CodeGenerator.Grammars.Translator.R as R
@@ -63,12 +65,15 @@ generate ::
   -> MorlocMonad (Script, [Script]) 
   -- ^ the nexus code and the source code for each language pool
 generate ms = do
+  -- measured interop costs and profiled run times, where available
+  costs <- loadCostModel
+
   -- translate modules into bitrees
   (gASTs, rASTs)
     -- eliminate morloc composition abstractions
     <-  mapM rewrite ms
     -- select a single instance at each node in the tree
-    >>= mapM realize   -- [Either (SAnno GMeta One CType) (SAnno GMeta One CType)]
+    >>= mapM (realize costs)   -- [Either (SAnno GMeta One CType) (SAnno GMeta One CType)]
     -- separate unrealized (general) ASTs (uASTs) from realized ASTs (rASTs)
     |>> partitionEithers
 
@@ -89,7 +94,7 @@ generate ms = do
   let srcs = unique . concat . conmap (unpackSAnno getSrcs) $ rASTs
 
   -- for each language, collect all functions into one "pool"
-  pools
+  segments
     -- thread arguments across the tree
     <- mapM parameterize rASTs
     -- convert from AST to manifold tree
@@ -105,8 +110,15 @@ generate ms = do
     -- segments from a given language into one pool. Later it may be more
     -- nuanced.
     >>= pool
-    -- Generate the code for each pool
-    >>= mapM (encode srcs)
+    -- Pass data straight through where it would be unpacked only to be
+    -- packed again, or the reverse
+    >>= elideRoundTrips
+
+  -- identify this build in the keys of cached pool results
+  programId <- programIdentity srcs segments
+
+  -- Generate the code for each pool
+  pools <- mapM (encode programId srcs) segments
 
   -- return the nexus script and each pool script
   return (nexus, pools)
@@ -246,11 +258,14 @@ rewrite (SAnno (Many es0) g0) = do
 
 -- | Select a single concrete language for each sub-expression.  Store the
 -- concrete type and the general type (if available).  Select pack/unpack
--- functions.
+-- functions. The cheapest instance is chosen by the costs of the calls it
+-- implies, as measured by `morloc calibrate` or else from a fixed table, plus
+-- the profiled run times of the functions it calls.
 realize
-  :: SAnno GMeta Many [CType]
+  :: CostModel
+  -> SAnno GMeta Many [CType]
   -> MorlocMonad (Either (SAnno GMeta One ()) (SAnno GMeta One TypeP))
-realize x0 = do
+realize costs x0 = do
   -- MM.say $ " --- realize ---"
   -- MM.say $ prettySAnnoMany x
   -- MM.say $ " ---------------"
@@ -305,8 +320,8 @@ realize x0 = do
     -- Q: a call should also be of the same language as the parent, shouldn't it?
     -- A: not necessarily, specifically if the parent includes many child calls, say in a list
     realizeExpr' _ lang (CallS src) c
-      -- FIXME: assuming function calls have 0 cost is perhaps not realistic
-      | lang == langOf c = return $ Just (0, CallS src, c)
+      -- a call costs its profiled run time, or nothing if it was not profiled
+      | lang == langOf c = return $ Just (callCost costs src, CallS src, c)
       | otherwise = return Nothing
     -- and a var?
     realizeExpr' _ lang (VarS x) c
@@ -353,7 +368,7 @@ realize x0 = do
       let lang' = (fromJust . langOf) c 
       fMay <- realizeAnno depth (Just lang') f
       xsMay <- mapM (realizeAnno depth (Just lang')) xs
-      case (fMay, (fmap unzip . sequence) xsMay, Lang.pairwiseCost lang lang') of
+      case (fMay, (fmap unzip . sequence) xsMay, interopCost costs lang lang') of
         (Just (fscore, f'), Just (scores, xs'), Just interopCost) ->
           return $ Just (fscore + sum scores + interopCost, AppS f' xs', c)
         _ -> return Nothing
@@ -735,16 +750,151 @@ express s0@(SAnno (One (_, (c0, _))) _) = express' True c0 s0 where
 
     if langOf pc == langOf c
       then return manifold
-      else return $ ForeignInterfaceM (typeP2typeM pc) manifold
+      -- A foreign function passed as a value. The foreign manifold is a
+      -- regular entry point that takes serialized arguments, the caller wraps
+      -- it in a native function that serializes each call.
+      else do
+        let serialArgs = zipWith SerialArgument [0 ..] inputs
+        serialVals <- mapM (unpackExprM m) $ zipWith BndVarM (map (packTypeM . typeP2typeM) inputs) [0 ..]
+        return . ForeignInterfaceM (typeP2typeM pc) $
+          ManifoldM m serialArgs (ReturnM $ AppM f serialVals)
 
   express' _ _ (SAnno (One (_, (t, _))) m) = MM.throwError . CallTheMonkeys . render $
     "Invalid input to express' in module (" <> viaShow (metaName m) <> ") - type: " <> prettyTypeP t
 
 -- | Move let assignments to minimize number of foreign calls.  This step
 -- should be integrated with the optimizations performed in the realize step.
--- FIXME: replace stub
+--
+-- Within the body of each manifold:
+--  * identical foreign calls are made once and their result is bound by a let
+--  * a foreign call in a lambda that does not read the lambda's arguments is
+--    floated out of the lambda, so it is made once rather than once per
+--    application
+--
+-- Morloc functions are assumed to be pure, so neither changes the result.
+-- The lets are bound at the top of the manifold body, since ExprM has no
+-- branches that a let could be sunk into. Nested manifolds are separate
+-- functions in every pool, so each is optimized on its own. The lets are
+-- numbered below zero, the indices that invertExprM assigns are not.
 letOptimize :: ExprM Many -> MorlocMonad (ExprM Many)
-letOptimize = return
+letOptimize e0 = do
+  let e' = optimize e0
+  verbosity <- MM.gets stateVerbosity
+  when (verbosity > 0) $
+    MM.say $ "letOptimize removed" <+> pretty (foreignCalls e0 - foreignCalls e') <+> "foreign calls"
+  return e'
+  where
+
+  optimize :: ExprM Many -> ExprM Many
+  optimize (ManifoldM m args e) = ManifoldM m args (hoist (optimize e))
+  optimize (ForeignInterfaceM t e) = ForeignInterfaceM t (optimize e)
+  optimize (LetM i e1 e2) = LetM i (optimize e1) (optimize e2)
+  optimize (AppM e es) = AppM (optimize e) (map optimize es)
+  optimize (LamM args e) = LamM args (optimize e)
+  optimize (AccM e k) = AccM (optimize e) k
+  optimize (ListM t es) = ListM t (map optimize es)
+  optimize (TupleM t es) = TupleM t (map optimize es)
+  optimize (RecordM t rs) = RecordM t (zip (map fst rs) (map (optimize . snd) rs))
+  optimize (SerializeM s e) = SerializeM s (optimize e)
+  optimize (DeserializeM s e) = DeserializeM s (optimize e)
+  optimize (ReturnM e) = ReturnM (optimize e)
+  optimize e = e
+
+  -- bind each repeated call in a manifold body once
+  hoist :: ExprM Many -> ExprM Many
+  hoist body = foldr (\(v, x) e -> LetM v x e) body' bound where
+    cs = calls [] body
+    shared = nubBy sameExprM
+      [x | (x, inLambda) <- cs, inLambda || length (filter (sameExprM x . fst) cs) > 1]
+    bound = zip [-1, -2 ..] shared
+    body' = foldr (\(v, x) e -> replace x (LetVarM (typeOfExprM x) v) e) body bound
+
+  -- the foreign calls that may be bound at the top of the manifold body and
+  -- whether they are in a lambda
+  calls :: [Int] -> ExprM Many -> [(ExprM Many, Bool)]
+  calls _ (ForeignInterfaceM (Function _ _) _) = []
+  calls bnds e@(ForeignInterfaceM _ x) = call bnds e x
+  calls bnds e@(DeserializeM _ (ForeignInterfaceM (Serial _) x)) = call bnds e x
+  calls _ (ManifoldM _ _ _) = []
+  calls bnds (LamM args e) = calls (map argId args ++ bnds) e
+  calls bnds (LetM _ e1 e2) = calls bnds e1 ++ calls bnds e2
+  calls bnds (AppM e es) = calls bnds e ++ conmap (calls bnds) es
+  calls bnds (AccM e _) = calls bnds e
+  calls bnds (ListM _ es) = conmap (calls bnds) es
+  calls bnds (TupleM _ es) = conmap (calls bnds) es
+  calls bnds (RecordM _ rs) = conmap (calls bnds . snd) rs
+  calls bnds (SerializeM _ e) = calls bnds e
+  calls bnds (DeserializeM _ e) = calls bnds e
+  calls bnds (ReturnM e) = calls bnds e
+  calls _ _ = []
+
+  -- a foreign call reads the variables that are its manifold's arguments
+  call :: [Int] -> ExprM Many -> ExprM Many -> [(ExprM Many, Bool)]
+  call bnds e (ManifoldM _ args _)
+    | any (flip elem bnds . argId) args = []
+    | otherwise = [(e, not (null bnds))]
+  call _ _ _ = []
+
+  replace :: ExprM Many -> ExprM Many -> ExprM Many -> ExprM Many
+  replace x v e | sameExprM x e = v
+  replace _ _ e@(ManifoldM _ _ _) = e
+  replace _ _ e@(ForeignInterfaceM _ _) = e
+  replace x v (LetM i e1 e2) = LetM i (replace x v e1) (replace x v e2)
+  replace x v (AppM e es) = AppM (replace x v e) (map (replace x v) es)
+  replace x v (LamM args e) = LamM args (replace x v e)
+  replace x v (AccM e k) = AccM (replace x v e) k
+  replace x v (ListM t es) = ListM t (map (replace x v) es)
+  replace x v (TupleM t es) = TupleM t (map (replace x v) es)
+  replace x v (RecordM t rs) = RecordM t (zip (map fst rs) (map (replace x v . snd) rs))
+  replace x v (SerializeM s e) = SerializeM s (replace x v e)
+  replace x v (DeserializeM s e) = DeserializeM s (replace x v e)
+  replace x v (ReturnM e) = ReturnM (replace x v e)
+  replace _ _ e = e
+
+  foreignCalls :: ExprM Many -> Int
+  foreignCalls (ForeignInterfaceM (Function _ _) e) = foreignCalls e
+  foreignCalls (ForeignInterfaceM _ e) = 1 + foreignCalls e
+  foreignCalls (ManifoldM _ _ e) = foreignCalls e
+  foreignCalls (LetM _ e1 e2) = foreignCalls e1 + foreignCalls e2
+  foreignCalls (AppM e es) = sum (map foreignCalls (e:es))
+  foreignCalls (LamM _ e) = foreignCalls e
+  foreignCalls (AccM e _) = foreignCalls e
+  foreignCalls (ListM _ es) = sum (map foreignCalls es)
+  foreignCalls (TupleM _ es) = sum (map foreignCalls es)
+  foreignCalls (RecordM _ rs) = sum (map (foreignCalls . snd) rs)
+  foreignCalls (SerializeM _ e) = foreignCalls e
+  foreignCalls (DeserializeM _ e) = foreignCalls e
+  foreignCalls (ReturnM e) = foreignCalls e
+  foreignCalls _ = 0
+
+-- | Structural equality of two expressions, ignoring node metadata. Serializers
+-- are not compared, they are determined by the type of the data they handle.
+sameExprM :: ExprM f -> ExprM f -> Bool
+sameExprM (ManifoldM _ args1 e1) (ManifoldM _ args2 e2) = args1 == args2 && sameExprM e1 e2
+sameExprM (ForeignInterfaceM t1 e1) (ForeignInterfaceM t2 e2) = t1 == t2 && sameExprM e1 e2
+sameExprM (PoolCallM t1 i1 _ args1) (PoolCallM t2 i2 _ args2) = t1 == t2 && i1 == i2 && args1 == args2
+sameExprM (LetM i1 x1 y1) (LetM i2 x2 y2) = i1 == i2 && sameExprM x1 x2 && sameExprM y1 y2
+sameExprM (AppM f1 xs1) (AppM f2 xs2) = sameExprM f1 f2 && sameExprMs xs1 xs2
+sameExprM (SrcM t1 s1) (SrcM t2 s2) = t1 == t2 && s1 == s2
+sameExprM (LamM args1 e1) (LamM args2 e2) = args1 == args2 && sameExprM e1 e2
+sameExprM (BndVarM t1 i1) (BndVarM t2 i2) = t1 == t2 && i1 == i2
+sameExprM (LetVarM t1 i1) (LetVarM t2 i2) = t1 == t2 && i1 == i2
+sameExprM (AccM e1 k1) (AccM e2 k2) = k1 == k2 && sameExprM e1 e2
+sameExprM (ListM t1 es1) (ListM t2 es2) = t1 == t2 && sameExprMs es1 es2
+sameExprM (TupleM t1 es1) (TupleM t2 es2) = t1 == t2 && sameExprMs es1 es2
+sameExprM (RecordM t1 rs1) (RecordM t2 rs2)
+  = t1 == t2 && map fst rs1 == map fst rs2 && sameExprMs (map snd rs1) (map snd rs2)
+sameExprM (LogM t1 x1) (LogM t2 x2) = t1 == t2 && x1 == x2
+sameExprM (NumM t1 x1) (NumM t2 x2) = t1 == t2 && x1 == x2
+sameExprM (StrM t1 x1) (StrM t2 x2) = t1 == t2 && x1 == x2
+sameExprM (NullM t1) (NullM t2) = t1 == t2
+sameExprM (SerializeM _ e1) (SerializeM _ e2) = sameExprM e1 e2
+sameExprM (DeserializeM _ e1) (DeserializeM _ e2) = sameExprM e1 e2
+sameExprM (ReturnM e1) (ReturnM e2) = sameExprM e1 e2
+sameExprM _ _ = False
+
+sameExprMs :: [ExprM f] -> [ExprM f] -> Bool
+sameExprMs xs ys = length xs == length ys && and (zipWith sameExprM xs ys)
 
 segment :: ExprM Many -> MorlocMonad [ExprM Many]
 segment e0
@@ -757,7 +907,10 @@ segment e0
     (ms, e') <- segment' m args' e
     config <- MM.ask
     case MC.buildPoolCallBase config (langOf e') (metaId m) of
-      (Just cmds) -> return (e':ms, PoolCallM (packTypeM t) (metaId m) cmds args)
+      -- a foreign function value takes its arguments when it is called
+      (Just cmds) -> case t of
+        (Function _ _) -> return (e':ms, PoolCallM t (metaId m) cmds [])
+        _ -> return (e':ms, PoolCallM (packTypeM t) (metaId m) cmds args)
       Nothing -> MM.throwError . OtherError $ "Unsupported language: " <> MT.show' (langOf e')
 
   segment' m args (SerializeM _ (AppM e@(ForeignInterfaceM _ _) es)) = do
@@ -871,20 +1024,59 @@ reparameterize e0 = snd (substituteBndArgs e0) where
 
 rehead :: ExprM Many -> MorlocMonad (ExprM Many)
 rehead (LamM _ e) = rehead e
-rehead (ManifoldM m args (ReturnM e)) = do
-  e' <- packExprM m e
-  return $ ManifoldM m args (ReturnM e')
+rehead (ManifoldM m args e0) = ManifoldM m args <$> packReturn e0 where
+  -- the return follows any lets that letOptimize bound
+  packReturn (LetM i e1 e2) = LetM i e1 <$> packReturn e2
+  packReturn (ReturnM e) = ReturnM <$> packExprM m e
+  packReturn _ = MM.throwError $ CallTheMonkeys "Bad Head"
 rehead _ = MM.throwError $ CallTheMonkeys "Bad Head"
 
 -- Sort manifolds into pools. Within pools, group manifolds into call sets.
 pool :: [ExprM Many] -> MorlocMonad [(Lang, [ExprM Many])]
 pool = return . groupSort . map (\e -> (fromJust $ langOf e, e))
 
+-- | Cancel every serialization that is immediately undone. These pairs
+-- appear wherever a manifold forwards a serialized argument it received to a
+-- foreign call, or returns a value that it just deserialized. The data never
+-- needs to leave its serialized form. Every deserializer reads both the JSON
+-- and the binary wire format, so a forwarded argument is valid whichever form
+-- it arrived in.
+elideRoundTrips :: [(Lang, [ExprM Many])] -> MorlocMonad [(Lang, [ExprM Many])]
+elideRoundTrips pools = do
+  let elided = [(lang, map elide es) | (lang, es) <- pools]
+      n = getSum (mconcat [k | (_, es) <- elided, (k, _) <- es])
+  verbosity <- MM.gets stateVerbosity
+  when (verbosity > 0) $
+    MM.say $ "elided" <+> pretty n <+> "serialization round-trips"
+  return [(lang, map snd es) | (lang, es) <- elided]
+  where
+    elide :: ExprM Many -> (Sum Int, ExprM Many)
+    elide (DeserializeM s e) = case elide e of
+      (k, SerializeM _ e') | typeOfExprM e' == unpackTypeM (typeOfExprM e) -> (k + 1, e')
+      (k, e') -> (k, DeserializeM s e')
+    elide (SerializeM s e) = case elide e of
+      (k, DeserializeM _ e') | typeOfExprM e' == packTypeM (typeOfExprM e) -> (k + 1, e')
+      (k, e') -> (k, SerializeM s e')
+    elide (ManifoldM m args e) = ManifoldM m args <$> elide e
+    elide (ForeignInterfaceM t e) = ForeignInterfaceM t <$> elide e
+    elide (LetM i e1 e2) = LetM i <$> elide e1 <*> elide e2
+    elide (AppM e es) = AppM <$> elide e <*> mapM elide es
+    elide (LamM args e) = LamM args <$> elide e
+    elide (AccM e k) = AccM <$> elide e <*> pure k
+    elide (ListM t es) = ListM t <$> mapM elide es
+    elide (TupleM t es) = TupleM t <$> mapM elide es
+    elide (RecordM t rs) = do
+      es <- mapM (elide . snd) rs
+      return $ RecordM t (zip (map fst rs) es)
+    elide (ReturnM e) = ReturnM <$> elide e
+    elide e = return e
+
 encode
-  :: [Source]
+  :: MDoc
+  -> [Source]
   -> (Lang, [ExprM Many])
   -> MorlocMonad Script
-encode srcs (lang, xs) = do
+encode programId srcs (lang, xs) = do
   state <- MM.get
 
   -- this function cleans up source names (if needed) and generates compiler flags and paths to search
@@ -893,7 +1085,7 @@ encode srcs (lang, xs) = do
 
   xs' <- mapM (preprocess lang) xs >>= chooseSerializer
   -- translate each node in the AST to code
-  code <- translate lang sources xs'
+  code <- translate lang programId sources xs'
 
   return $ Script
     { scriptBase = "pool"
@@ -954,16 +1146,33 @@ chooseSerializer xs = mapM chooseSerializer' xs where
   oneSerial (SerialNull t) = return $ SerialNull t
   oneSerial (SerialUnknown t) = return $ SerialUnknown t
 
-translate :: Lang -> [Source] -> [ExprM One] -> MorlocMonad MDoc
-translate lang srcs es = do
+translate :: Lang -> MDoc -> [Source] -> [ExprM One] -> MorlocMonad MDoc
+translate lang programId srcs es = do
   case lang of
-    CppLang -> Cpp.translate srcs es
-    RLang -> R.translate srcs es
-    Python3Lang -> Python3.translate srcs es
+    CppLang -> Cpp.translate programId srcs es
+    RLang -> R.translate programId srcs es
+    Python3Lang -> Python3.translate programId srcs es
     x -> MM.throwError . PoolBuildError . render
       $ "Language '" <> viaShow x <> "' has no translator"
 
 
+-- | Identify a build of the program. A cached pool result is reused only by a
+-- build with the same id, that is, one with the same manifolds calling the
+-- same source files. Any change invalidates the whole cache, since a manifold
+-- may depend on code in any pool.
+programIdentity :: [Source] -> [(Lang, [ExprM Many])] -> MorlocMonad MDoc
+programIdentity srcs pools = do
+  contents <- liftIO . mapM readSource . unique . catMaybes . map srcPath $ srcs
+  let code = render . vsep $ [viaShow lang <> line <> vsep (map prettyExprM es) | (lang, es) <- pools]
+  return . pretty . MT.fnv1a . MT.concat $ code : contents
+  where
+    readSource :: Path -> IO MT.Text
+    readSource path = do
+      exists <- MS.fileExists path
+      if exists
+        then MT.readFile (MT.unpack (unPath path))
+        else return (unPath path)
+
 -------- Utility and lookup functions ----------------------------------------
 
 unpackSAnno :: (SExpr g One c -> g -> c -> a) -> SAnno g One c -> [a]
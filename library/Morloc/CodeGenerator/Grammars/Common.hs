@@ -28,6 +28,10 @@ module Morloc.CodeGenerator.Grammars.Common
   , prettyTypeM
   , prettyTypeP
   , splitArgs
+  , replyIndices
+  , profileLabel
+  , traceName
+  , resultCache
   ) where
 
 import Morloc.Data.Doc
@@ -165,9 +169,18 @@ invertExprM (ManifoldM m args e) = do
   MM.startCounter
   e' <- invertExprM e
   return $ ManifoldM m args e'
+-- lets bound before inversion are renumbered, a value that is already bound
+-- to a let variable is referred to by that variable
 invertExprM (LetM v e1 e2) = do
-  e2' <- invertExprM e2
-  return $ LetM v e1 e2'
+  e1' <- invertExprM e1
+  case terminalOf e1' of
+    (LetVarM _ v') -> do
+      e2' <- invertExprM (renameLetVar v v' e2)
+      return $ dependsOn e2' e1'
+    x -> do
+      v' <- MM.getCounter
+      e2' <- invertExprM (renameLetVar v v' e2)
+      return $ dependsOn (LetM v' x e2') e1'
 invertExprM e@(AppM f es) = do
   f' <- invertExprM f
   es' <- mapM invertExprM es
@@ -217,6 +230,25 @@ invertExprM (PoolCallM t i cmds args) = do
   return $ LetM v (PoolCallM t i cmds args) (LetVarM t v)
 invertExprM e = return e
 
+-- rename a let variable within a manifold body, nested manifolds have their
+-- own let variables
+renameLetVar :: Int -> Int -> ExprM f -> ExprM f
+renameLetVar v v' = f where
+  f (LetVarM t i) = LetVarM t (if i == v then v' else i)
+  f e@(ManifoldM _ _ _) = e
+  f e@(ForeignInterfaceM _ _) = e
+  f (LetM i e1 e2) = LetM i (f e1) (f e2)
+  f (AppM e es) = AppM (f e) (map f es)
+  f (LamM args e) = LamM args (f e)
+  f (AccM e k) = AccM (f e) k
+  f (ListM t es) = ListM t (map f es)
+  f (TupleM t es) = TupleM t (map f es)
+  f (RecordM t rs) = RecordM t (zip (map fst rs) (map (f . snd) rs))
+  f (SerializeM s e) = SerializeM s (f e)
+  f (DeserializeM s e) = DeserializeM s (f e)
+  f (ReturnM e) = ReturnM (f e)
+  f e = e
+
 -- transfer all let-dependencies from y to x
 --
 -- Technically, I should check for variable reuse in the let-chain and
@@ -339,3 +371,48 @@ splitArgs args1 args2 = partitionEithers $ map splitOne args1 where
                then Left r
                else Right r
 
+-- | Find the let indices of the values that a pool's root manifold returns to
+-- its caller. The caller may be the nexus, which only reads JSON, so these are
+-- serialized in the format the caller asked for. Everything else is
+-- serialized in the build's wire format.
+replyIndices :: ExprM f -> [Int]
+replyIndices (ManifoldM _ _ e0) = f e0 where
+  f (LetM _ _ e) = f e
+  f (ReturnM (LetVarM _ i)) = [i]
+  f _ = []
+replyIndices _ = []
+
+-- | The name of the source function whose result a manifold returns. A pool
+-- records the run times of a manifold under this name when profiling, since
+-- manifold ids change between builds. A manifold that returns anything else,
+-- such as a list it builds, has no label and is not profiled.
+profileLabel :: ExprM f -> Maybe MT.Text
+profileLabel (ManifoldM _ _ e0) = f e0 where
+  f (LetM _ _ e) = f e
+  f (ReturnM e) = call e
+  f _ = Nothing
+
+  -- a let variable refers to the latest binding of its index
+  call (LetVarM _ i) = lookup i (reverse (lets e0)) >>= call
+  call (SerializeM _ e) = call e
+  call (AppM (SrcM _ src) _) = Just (unName (srcName src))
+  call _ = Nothing
+
+  lets (LetM i e1 e2) = (i, e1) : lets e2
+  lets _ = []
+profileLabel _ = Nothing
+
+-- | The name of a manifold in a trace: the name of its function in the pool
+-- and, if it has one, its profile label
+traceName :: ExprM f -> MT.Text
+traceName m@(ManifoldM g _ _) =
+  "m" <> MT.show' (metaId g) <> maybe "" (" " <>) (profileLabel m)
+traceName _ = "?"
+
+-- | The directory of the on-disk result cache and its size limit in bytes. A
+-- limit of 0 turns the cache off.
+resultCache :: MorlocMonad (MDoc, Integer)
+resultCache = do
+  tmpdir <- MM.asks configTmpDir
+  megabytes <- MM.asks configResultCache
+  return (pretty (unPath tmpdir) <> "/cache", toInteger megabytes * 1024 * 1024)
@@ -13,6 +13,7 @@ module Morloc.CodeGenerator.Grammars.Translator.Cpp
   ( 
     translate
   , preprocess
+  , benchRecord
   ) where
 
 import Morloc.CodeGenerator.Namespace
@@ -54,8 +55,8 @@ type RecMap = [((PVar, [PVar]), RecEntry)]
 preprocess :: ExprM Many -> MorlocMonad (ExprM Many)
 preprocess = invertExprM
 
-translate :: [Source] -> [ExprM One] -> MorlocMonad MDoc
-translate srcs es = do
+translate :: MDoc -> [Source] -> [ExprM One] -> MorlocMonad MDoc
+translate programId srcs es = do
   -- translate sources
   includeDocs <- mapM
     translateSource
@@ -68,14 +69,21 @@ translate srcs es = do
       (autoDecl, autoSerial) = generateAnonymousStructs recmap
       (srcDecl, srcSerial) = generateSourcedSerializers es
       dispatch = makeDispatch es
+      labels = makeProfileLabels es
       signatures = map (makeSignature recmap) es
       serializationCode = autoDecl ++ srcDecl ++ autoSerial ++ srcSerial
 
+  threads <- MM.asks configPoolThreads
+
   -- translate each manifold tree, rooted on a call from nexus or another pool
-  mDocs <- mapM (translateManifold recmap) es
+  mDocs <- mapM (translateManifold recmap threads) es
+
+  wire <- MM.asks configWireFormat
+
+  cache <- resultCache
 
   -- create and return complete pool script
-  return $ makeMain includeDocs signatures serializationCode mDocs dispatch
+  return $ makeMain wire threads cache programId labels includeDocs signatures serializationCode mDocs dispatch
 
 letNamer :: Int -> MDoc
 letNamer i = "a" <> viaShow i
@@ -93,8 +101,7 @@ makeSignature :: RecMap -> ExprM One -> MDoc
 makeSignature recmap e0@(ManifoldM _ _ _) = vsep (f e0) where
   f :: ExprM One -> [MDoc]
   f (ManifoldM (metaId->i) args e) =
-    let t = typeOfExprM e
-        sig = showTypeM recmap t <+> manNamer i <> tupled (map (makeArg recmap) args) <> ";"
+    let sig = manifoldDecl recmap (typeOfExprM e) i args <> ";"
     in sig : f e
   f (LetM _ e1 e2) = f e1 ++ f e2
   f (AppM e es) = f e ++ conmap f es
@@ -109,10 +116,31 @@ makeSignature recmap e0@(ManifoldM _ _ _) = vsep (f e0) where
   f _ = []
 makeSignature _ _ = error "Expected ManifoldM"
 
+-- | The declaration of a manifold. Function-typed arguments are template
+-- parameters, so a manifold may be passed a lambda or a foreign function
+-- without wrapping it in a type-erased std::function.
+manifoldDecl :: RecMap -> TypeM -> Int -> [Argument] -> MDoc
+manifoldDecl recmap t i args = template <> showTypeM recmap t <+> manNamer i <> tupled (map (makeArg recmap) args)
+  where
+    template = case [templateParam j | NativeArgument j (FunP _ _) <- args] of
+      [] -> ""
+      ps -> "template<" <> cat (punctuate "," ["class" <+> p | p <- ps]) <> "> "
+
+templateParam :: Int -> MDoc
+templateParam i = "F" <> viaShow i
+
+-- | Manifolds read their arguments but never modify them, so every argument is
+-- passed by const reference and a call between manifolds copies nothing.
+-- Sourced functions must accordingly take their arguments by value or by
+-- const reference.
 makeArg :: RecMap -> Argument -> MDoc
-makeArg _ (SerialArgument i _) = serialType <+> bndNamer i
-makeArg recmap (NativeArgument i c) = showTypeM recmap (Native c) <+> bndNamer i
-makeArg _ (PassThroughArgument i) = serialType <+> bndNamer i
+makeArg _ (SerialArgument i _) = constRef serialType (bndNamer i)
+makeArg _ (NativeArgument i (FunP _ _)) = constRef (templateParam i) (bndNamer i)
+makeArg recmap (NativeArgument i c) = constRef (showTypeM recmap (Native c)) (bndNamer i)
+makeArg _ (PassThroughArgument i) = constRef serialType (bndNamer i)
+
+constRef :: MDoc -> MDoc -> MDoc
+constRef t v = "const" <+> t <+> "&" <> v
 
 argName :: Argument -> MDoc
 argName (SerialArgument i _) = bndNamer i
@@ -152,16 +180,17 @@ translateSource path = return $
 
 serialize
   :: RecMap
+  -> MDoc -- The wire format variable, @_morloc_wire@ or @_morloc_reply@
   -> Int -- The let index `i`
   -> MDoc -- A variable name pointing to e1
   -> SerialAST One
   -> MorlocMonad [MDoc]
-serialize recmap letIndex datavar0 s0 = do
+serialize recmap wire letIndex datavar0 s0 = do
   (x, before) <- serialize' datavar0 s0
   t0 <- (showTypeM recmap . Native) <$> serialAstToType s0
   let schemaName = [idoc|#{letNamer letIndex}_schema|]
       schema = [idoc|#{t0} #{schemaName};|]
-      final = [idoc|#{serialType} #{letNamer letIndex} = serialize(#{x}, #{schemaName});|]
+      final = [idoc|#{serialType} #{letNamer letIndex} = _morloc_serialize(#{x}, #{schemaName}, #{wire});|]
   return (before ++ [schema, final])
 
   where
@@ -216,7 +245,7 @@ deserialize recmap letIndex typestr0 varname0 s0
   | isSerializable s0 = do 
       let schemaName = [idoc|#{letNamer letIndex}_schema|]
           schema = [idoc|#{typestr0} #{schemaName};|]
-          deserializing = [idoc|#{typestr0} #{letNamer letIndex} = deserialize(#{varname0}, #{schemaName});|]
+          deserializing = [idoc|#{typestr0} #{letNamer letIndex} = _morloc_deserialize(#{varname0}, #{schemaName});|]
       return [schema, deserializing]
   | otherwise = do
       idx <- fmap pretty $ MM.getCounter
@@ -225,7 +254,7 @@ deserialize recmap letIndex typestr0 varname0 s0
           schemaName = [idoc|#{letNamer letIndex}_schema|]
           rawvar = "s" <> idx
           schema = [idoc|#{rawtype} #{schemaName};|]
-          deserializing = [idoc|#{rawtype} #{rawvar} = deserialize(#{varname0}, #{schemaName});|]
+          deserializing = [idoc|#{rawtype} #{rawvar} = _morloc_deserialize(#{varname0}, #{schemaName});|]
       (x, before) <- construct rawvar s0
       let final = [idoc|#{typestr0} #{letNamer letIndex} = #{x};|]
       return ([schema, deserializing] ++ before ++ [final])
@@ -276,13 +305,34 @@ deserialize recmap letIndex typestr0 varname0 s0
     construct _ s = MM.throwError . SerializationError . render
       $ "deserializeDescend: " <> prettySerialOne s
 
-translateManifold :: RecMap -> ExprM One -> MorlocMonad MDoc
-translateManifold recmap m0@(ManifoldM _ args0 _) = do
+-- | When @threads@ is greater than 1, the foreign calls of a manifold are all
+-- started when the manifold is entered and their results are collected where
+-- they are bound. Foreign calls depend only on the manifold arguments, so
+-- calls that feed different branches of the manifold run concurrently.
+translateManifold :: RecMap -> Int -> ExprM One -> MorlocMonad MDoc
+translateManifold recmap threads m0@(ManifoldM _ args0 _) = do
   MM.startCounter
-  (vsep . punctuate line . (\(x,_,_)->x)) <$> f args0 m0
+  (vsep . punctuate line . (\(x,_,_)->x)) <$> f [] args0 m0
   where
 
-  f :: [Argument]
+  replies = replyIndices m0
+
+  concurrent = threads > 1
+
+  -- start every foreign call bound in the let chain of a manifold body
+  launch :: ExprM One -> [MDoc]
+  launch (LetM _ (PoolCallM (Function _ _) _ _ _) e) = launch e
+  launch (LetM i (PoolCallM _ _ cmds args) e) =
+    let start = [idoc|std::future<std::string> #{letNamer i}_future = _morloc_async([=](){ return #{foreignCall cmds args}; });|]
+    in start : launch e
+  launch (LetM _ _ e) = launch e
+  launch _ = []
+
+  wireOf :: Int -> MDoc
+  wireOf i = if elem i replies then "_morloc_reply" else "_morloc_wire"
+
+  f :: [Int] -- let variables read once in the current manifold
+    -> [Argument]
     -> ExprM One
     -> MorlocMonad
        ( [MDoc] -- the collection of final manifolds
@@ -290,94 +340,139 @@ translateManifold recmap m0@(ManifoldM _ args0 _) = do
        , [MDoc] -- a list of statements that should precede this assignment
        )
 
-  f args (LetM i (SerializeM s e1) e2) = do
-    (ms1, e1', ps1) <- f args e1
-    (ms2, e2', ps2) <- f args e2
-    serialized <- serialize recmap i e1' s
+  f once args (LetM i (SerializeM s e1) e2) = do
+    (ms1, e1', ps1) <- f once args e1
+    (ms2, e2', ps2) <- f once args e2
+    serialized <- serialize recmap (wireOf i) i e1' s
     return (ms1 ++ ms2, vsep $ ps1 ++ ps2 ++ serialized ++ [e2'], [])
 
-  f args (LetM i (DeserializeM s e1) e2) = do
-    (ms1, e1', ps1) <- f args e1
-    (ms2, e2', ps2) <- f args e2
+  f once args (LetM i (DeserializeM s e1) e2) = do
+    (ms1, e1', ps1) <- f once args e1
+    (ms2, e2', ps2) <- f once args e2
     t <- showNativeTypeM recmap (typeOfExprM e1)
     deserialized <- deserialize recmap i t e1' s
     return (ms1 ++ ms2, vsep $ ps1 ++ ps2 ++ deserialized ++ [e2'], [])
 
-  f _ (SerializeM _ _) = MM.throwError . SerializationError
+  f _ _ (SerializeM _ _) = MM.throwError . SerializationError
     $ "SerializeM should only appear in an assignment"
 
-  f _ (DeserializeM _ _) = MM.throwError . SerializationError
+  f _ _ (DeserializeM _ _) = MM.throwError . SerializationError
     $ "DeserializeM should only appear in an assignment"
 
-  f args (LetM i e1 e2) = do
-    (ms1', e1', ps1) <- (f args) e1
-    (ms2', e2', ps2) <- (f args) e2
-    let t = showTypeM recmap (typeOfExprM e1)
+  -- keep the foreign function type, a std::function could not be prefetched
+  f once args (LetM i e1@(PoolCallM (Function _ _) _ _ _) e2) = do
+    (ms1', e1', ps1) <- (f once args) e1
+    (ms2', e2', ps2) <- (f once args) e2
+    let ps = ps1 ++ ps2 ++ [[idoc|auto #{letNamer i} = #{e1'};|], e2']
+    return (ms1' ++ ms2', vsep ps, [])
+
+  -- the call was started on entry to the manifold
+  f once args (LetM i (PoolCallM t _ _ _) e2) | concurrent = do
+    (ms2', e2', ps2) <- (f once args) e2
+    let ps = ps2 ++ [[idoc|#{showTypeM recmap t} #{letNamer i} = #{letNamer i}_future.get();|], e2']
+    return (ms2', vsep ps, [])
+
+  f once args (LetM i e1 e2) = do
+    (ms1', e1', ps1) <- (f once args) e1
+    (ms2', e2', ps2) <- (f once args) e2
+    let t = case typeOfExprM e1 of
+          -- keep the closure type, a std::function would hide it
+          (Function _ _) -> "auto"
+          t' -> showTypeM recmap t'
         ps = ps1 ++ ps2 ++ [[idoc|#{t} #{letNamer i} = #{e1'};|], e2']
     return (ms1' ++ ms2', vsep ps, [])
 
-  f args (AppM (SrcM (Function inputs output) src) xs) = do
-    (mss', xs', pss) <- mapM (f args) xs |>> unzip3
+  f once args (AppM (SrcM (Function inputs output) src) xs) = do
+    (mss', xs', pss) <- mapM (f once args) xs |>> unzip3
     let
         name = pretty $ srcName src
         mangledName = mangleSourceName name
         inputBlock = cat (punctuate "," (map (showTypeM recmap) inputs))
         sig = [idoc|#{showTypeM recmap output}(*#{mangledName})(#{inputBlock}) = &#{name};|]
-    return (concat mss', mangledName <> tupled xs', sig : concat pss)
-
-  f _ (AppM _ _) = error "Can only apply functions"
-
-  f _ (SrcM _ src) = return ([], pretty $ srcName src, [])
-
-  f pargs (ManifoldM (metaId->i) args e) = do
-    (ms', body, ps1) <- f args e
-    let t = typeOfExprM e
-        decl = showTypeM recmap t <+> manNamer i <> tupled (map (makeArg recmap) args)
-        mdoc = block 4 decl body
+        -- evaluate foreign functions on the data they will be applied to in
+        -- one batched call, e.g., a foreign function mapped over a list
+        unary (Function [_] _) = True
+        unary _ = False
+        function (Function _ _) = True
+        function _ = False
+        prefetches =
+          [ [idoc|_morloc_prefetch(#{g}, #{x});|]
+          | (tg, g) <- zip inputs xs', unary tg
+          , (tx, x) <- zip inputs xs', not (function tx)]
+        -- A direct call lets the compiler inline the sourced function and
+        -- any function passed to it. The typed alias is only needed when a
+        -- literal may not have the exact type of the parameter, so that the
+        -- right template instance or overload is chosen. A sourced function
+        -- that takes a function should take it as a template parameter, a
+        -- closure cannot be deduced as a std::function parameter.
+        literal (NumM _ _) = True
+        literal (StrM _ _) = True
+        literal (LogM _ _) = True
+        literal (NullM _) = True
+        literal (ListM _ _) = True
+        literal (TupleM _ _) = True
+        literal _ = False
+        direct = not (any literal xs)
+        -- a value read only here is moved into the call rather than copied
+        move (LetVarM _ j) x | elem j once = "std::move" <> parens x
+        move _ x = x
+        xs'' = zipWith move xs xs'
+    return $ if direct
+      then (concat mss', name <> tupled xs'', concat pss ++ prefetches)
+      else (concat mss', mangledName <> tupled xs'', sig : concat pss ++ prefetches)
+
+  f _ _ (AppM _ _) = error "Can only apply functions"
+
+  f _ _ (SrcM _ src) = return ([], pretty $ srcName src, [])
+
+  f _ pargs m@(ManifoldM (metaId->i) args e) = do
+    (ms', body, ps1) <- f (singleUse e) args e
+    let decl = manifoldDecl recmap (typeOfExprM e) i args
+        starts = if concurrent then launch e else []
+        -- records the manifold when the pool is traced
+        traced = [idoc|_morloc_span _span(#{dquotes (pretty (traceName m))});|]
+        mdoc = block 4 decl (vsep (traced : starts ++ [body]))
         mname = manNamer i
-    (call, ps2) <- case (splitArgs args pargs, nargsTypeM t) of
-      ((rs, []), _) -> return (mname <> tupled (map (bndNamer . argId) rs), [])
-      (([], _ ), _) -> return (mname, [])
-      ((rs, vs), _) -> do
-        let v = mname <> "_fun"
-        lhs <- stdFunction recmap t vs |>> (\x -> x <+> v)
-        castFunction <- staticCast recmap t args mname
-        let vs' = take
-                  (length vs)
-                  (map (\j -> "std::placeholders::_" <> viaShow j) ([1..] :: [Int]))
-            rs' = map (bndNamer . argId) rs
-            rhs = stdBind $ castFunction : (rs' ++ vs')
-            sig = nest 4 (vsep [lhs <+> "=", rhs]) <> ";"
-        return (v, [sig])
+        templated = not (null [j | NativeArgument j (FunP _ _) <- args])
+        (call, ps2) = case splitArgs args pargs of
+          (rs, []) -> (mname <> tupled (map (bndNamer . argId) rs), [])
+          ([], _) | not templated -> (mname, [])
+          -- a partially applied manifold becomes a closure over the bound
+          -- arguments that the compiler can inline
+          (_, vs) ->
+            let v = mname <> "_fun"
+                params = tupled [constRef (argTypeM recmap r) (argName r) | r <- vs]
+                closure = [idoc|auto #{v} = [=]#{params}{ return #{mname}#{tupled (map argName args)}; };|]
+            in (v, [closure])
     return (mdoc : ms', call, ps1 ++ ps2)
 
-  f _ (PoolCallM _ _ cmds args) = do
-    let bufDef = "std::ostringstream s;"
-        callArgs = map dquotes cmds ++ map argName args
-        cmd = "s << " <> cat (punctuate " << \" \" << " callArgs) <> ";"
-        call = [idoc|foreign_call(s.str())|] 
-    return ([], call, [bufDef, cmd])
+  f _ _ (PoolCallM (Function inputs output) _ cmds _) = do
+    let cmd = encloseSep "{" "}" "," (map dquotes cmds)
+        types = cat (punctuate "," (map (showTypeM recmap) (output : inputs)))
+    return ([], [idoc|_foreign_function<#{types}>(#{cmd})|], [])
+
+  f _ _ (PoolCallM _ _ cmds args) = return ([], foreignCall cmds args, [])
 
-  f _ (ForeignInterfaceM _ _) = MM.throwError . CallTheMonkeys $
+  f _ _ (ForeignInterfaceM _ _) = MM.throwError . CallTheMonkeys $
     "Foreign interfaces should have been resolved before passed to the translators"
 
-  f _ (LamM _ _) = undefined
+  f _ _ (LamM _ _) = undefined
 
-  f args (AccM e k) = do
-    (ms, e', ps) <- f args e
+  f once args (AccM e k) = do
+    (ms, e', ps) <- f once args e
     return (ms, e' <> "." <> pretty k, ps)
 
-  f args (ListM _ es) = do
-    (mss', es', pss) <- mapM (f args) es |>> unzip3
+  f once args (ListM _ es) = do
+    (mss', es', pss) <- mapM (f once args) es |>> unzip3
     let x' = encloseSep "{" "}" "," es'
     return (concat mss', x', concat pss)
 
-  f args (TupleM _ es) = do
-    (mss', es', pss) <- mapM (f args) es |>> unzip3
+  f once args (TupleM _ es) = do
+    (mss', es', pss) <- mapM (f once args) es |>> unzip3
     return (concat mss', "std::make_tuple" <> tupled es', concat pss)
 
-  f args (RecordM c entries) = do
-    (mss', es', pss) <- mapM (f args . snd) entries |>> unzip3
+  f once args (RecordM c entries) = do
+    (mss', es', pss) <- mapM (f once args . snd) entries |>> unzip3
     idx <- fmap pretty $ MM.getCounter
     let t = showTypeM recmap c
         v' = "a" <> idx
@@ -385,17 +480,41 @@ translateManifold recmap m0@(ManifoldM _ args0 _) = do
         x = [idoc|#{t} #{v'} = #{decl};|]
     return (concat mss', v', concat pss ++ [x])
 
-  f _ (BndVarM _ i) = return ([], bndNamer i, [])
-  f _ (LetVarM _ i) = return ([], letNamer i, [])
-  f _ (LogM _ x) = return ([], if x then "true" else "false", [])
-  f _ (NumM _ x) = return ([], viaShow x, [])
-  f _ (StrM _ x) = return ([], dquotes $ pretty x, [])
-  f _ (NullM _) = return ([], "null", [])
+  f _ _ (BndVarM _ i) = return ([], bndNamer i, [])
+  f _ _ (LetVarM _ i) = return ([], letNamer i, [])
+  f _ _ (LogM _ x) = return ([], if x then "true" else "false", [])
+  f _ _ (NumM _ x) = return ([], viaShow x, [])
+  f _ _ (StrM _ x) = return ([], dquotes $ pretty x, [])
+  f _ _ (NullM _) = return ([], "null", [])
 
-  f args (ReturnM e) = do
-    (ms, e', ps) <- f args e
+  f once args (ReturnM e) = do
+    (ms, e', ps) <- f once args e
     return (ms, "return(" <> e' <> ");", ps)
-translateManifold _ _ = error "Every ExprM object must start with a Manifold term"
+translateManifold _ _ _ = error "Every ExprM object must start with a Manifold term"
+
+-- | The let variables that are read exactly once in a manifold body. Such a
+-- value may be moved into its use rather than copied. Nested manifolds are
+-- separate functions with their own let variables, so they are not searched.
+singleUse :: ExprM f -> [Int]
+singleUse e0 = [i | i <- unique vs, length (filter (== i) vs) == 1] where
+  vs = uses e0
+
+  uses (LetM _ e1 e2) = uses e1 ++ uses e2
+  uses (AppM e es) = uses e ++ conmap uses es
+  uses (AccM e _) = uses e
+  uses (ListM _ es) = conmap uses es
+  uses (TupleM _ es) = conmap uses es
+  uses (RecordM _ rs) = conmap (uses . snd) rs
+  uses (SerializeM _ e) = uses e
+  uses (DeserializeM _ e) = uses e
+  uses (ReturnM e) = uses e
+  uses (LetVarM _ i) = [i]
+  uses _ = []
+
+foreignCall :: [MDoc] -> [Argument] -> MDoc
+foreignCall cmds args = [idoc|foreign_call(#{cmd}, #{callArgs})|] where
+  cmd = encloseSep "{" "}" "," (map dquotes cmds)
+  callArgs = encloseSep "{" "}" "," (map argName args)
 
 -- take a name from the source and return a new function name
 -- this must work even if there is a namespace, for example:
@@ -404,22 +523,6 @@ mangleSourceName :: MDoc -> MDoc
 mangleSourceName var = case MT.breakOnEnd "::" (render var) of
   (_, var') -> pretty $ var' <> "_fun"
 
-stdFunction :: RecMap -> TypeM -> [Argument] -> MorlocMonad MDoc
-stdFunction recmap t args = 
-  let argList = cat (punctuate "," (map (argTypeM recmap) args))
-  in return [idoc|std::function<#{showTypeM recmap t}(#{argList})>|]
-
-stdBind :: [MDoc] -> MDoc
-stdBind xs = [idoc|std::bind(#{args})|] where
-  args = cat (punctuate "," xs)
-
-staticCast :: RecMap -> TypeM -> [Argument] -> MDoc -> MorlocMonad MDoc
-staticCast recmap t args name = do
-  let output = showTypeM recmap t
-      inputs = map (argTypeM recmap) args
-      argList = cat (punctuate "," inputs)
-  return $ [idoc|static_cast<#{output}(*)(#{argList})>(&#{name})|]
-
 argTypeM :: RecMap -> Argument -> MDoc
 argTypeM _ (SerialArgument _ _) = serialType
 argTypeM recmap (NativeArgument _ c) = showType recmap c
@@ -430,7 +533,7 @@ makeDispatch ms = block 4 "switch(cmdID)" (vsep (map makeCase ms))
   where
     makeCase :: ExprM One -> MDoc
     makeCase (ManifoldM (metaId->i) args _) =
-      let args' = take (length args) $ map (\j -> "argv[" <> viaShow j <> "]") ([2..] :: [Int])
+      let args' = take (length args) $ map (\j -> "args[" <> viaShow j <> "]") ([0..] :: [Int])
       in
         (nest 4 . vsep)
           [ "case" <+> viaShow i <> ":"
@@ -439,6 +542,18 @@ makeDispatch ms = block 4 "switch(cmdID)" (vsep (map makeCase ms))
           ]
     makeCase _ = error "Every ExprM must start with a manifold object"
 
+-- | The names under which the run times of the root manifolds are profiled
+makeProfileLabels :: [ExprM One] -> MDoc
+makeProfileLabels ms = block 4 "const char* _morloc_profile_label(int cmdID)" $
+  block 4 "switch(cmdID)" (vsep (map makeCase (mapMaybe labelOf ms) ++ ["default:" <+> "return \"\";"]))
+  where
+    labelOf :: ExprM One -> Maybe (Int, MT.Text)
+    labelOf m@(ManifoldM (metaId->i) _ _) = (,) i <$> profileLabel m
+    labelOf _ = Nothing
+
+    makeCase :: (Int, MT.Text) -> MDoc
+    makeCase (i, label) = "case" <+> viaShow i <> ":" <+> "return" <+> dquotes (pretty label) <> ";"
+
 showType :: RecMap -> TypeP -> MDoc
 showType _ (UnkP _) = serialType
 showType _ (VarP (PV _ _ v)) = pretty v 
@@ -563,6 +678,27 @@ makeSerializers recmap rec
     serializer = serializerTemplate params rtype fields
     deserializer = deserializerTemplate False params rtype fields
 
+-- | The record of the serialization benchmarks, written as a struct followed
+-- by its serializers, as records are generated for a pool. The fields match
+-- @make_record@ in @bench/cpp/serial-throughput.cpp@. The benchmarks and the
+-- test suite both compile that file against it.
+benchRecord :: MDoc
+benchRecord = vsep
+  [ structTypedefTemplate [] rname fields
+  , serialHeaderTemplate [] rname
+  , deserialHeaderTemplate [] rname
+  , serializerTemplate [] rname fields
+  , deserializerTemplate False [] rname fields
+  ]
+  where
+    rname = "bench_record"
+    fields =
+      [ ("name", "std::string")
+      , ("count", "int")
+      , ("score", "double")
+      , ("tags", "std::vector<std::string>")
+      , ("valid", "bool")
+      ]
 
 
 generateSourcedSerializers :: [ExprM One] -> ([MDoc],[MDoc])
@@ -656,23 +792,29 @@ structTypedefTemplate params rname fields = vsep [template, struct] where
 
 -- Example
 -- > template <class T>
--- > std::string serialize(person<T> x, person<T> schema);
+-- > void serialize(const person<T> &x, const person<T> &schema, std::string &json);
+-- > template <class T>
+-- > void binary_serialize(const person<T> &x, const person<T> &schema, std::string &buf);
 serialHeaderTemplate :: [MDoc] -> MDoc -> MDoc
-serialHeaderTemplate params rtype = vsep [template, prototype]
+serialHeaderTemplate params rtype = vsep [template, prototype, template, binaryPrototype]
   where
   template = makeTemplateHeader params
-  prototype = [idoc|std::string serialize(#{rtype} x, #{rtype} schema);|]
+  prototype = [idoc|void serialize(const #{rtype} &x, const #{rtype} &schema, std::string &json);|]
+  binaryPrototype = [idoc|void binary_serialize(const #{rtype} &x, const #{rtype} &schema, std::string &buf);|]
 
 
 
 -- Example:
 -- > template <class T>
--- > bool deserialize(const std::string json, size_t &i, person<T> &x);
+-- > bool deserialize(const std::string &json, size_t &i, person<T> &x);
+-- > template <class T>
+-- > bool binary_deserialize(const std::string &buf, size_t &i, person<T> &x);
 deserialHeaderTemplate :: [MDoc] -> MDoc -> MDoc
-deserialHeaderTemplate params rtype = vsep [template, prototype]
+deserialHeaderTemplate params rtype = vsep [template, prototype, template, binaryPrototype]
   where
   template = makeTemplateHeader params
-  prototype = [idoc|bool deserialize(const std::string json, size_t &i, #{rtype} &x);|]
+  prototype = [idoc|bool deserialize(const std::string &json, size_t &i, #{rtype} &x);|]
+  binaryPrototype = [idoc|bool binary_deserialize(const std::string &buf, size_t &i, #{rtype} &x);|]
 
 
 
@@ -683,16 +825,25 @@ serializerTemplate
   -> MDoc -- output serializer function
 serializerTemplate params rtype fields = [idoc|
 #{makeTemplateHeader params}
-std::string serialize(#{rtype} x, #{rtype} schema){
+void serialize(const #{rtype} &x, const #{rtype} &schema, std::string &json){
+    #{schemata}
+    json += '{';
+    #{align $ vsep (punctuate (line <> "json += ',';") writers)}
+    json += '}';
+}
+
+#{makeTemplateHeader params}
+void binary_serialize(const #{rtype} &x, const #{rtype} &schema, std::string &buf){
     #{schemata}
-    std::ostringstream json;
-    json << "{" << #{align $ vsep (punctuate " << ',' <<" writers)} << "}";
-    return json.str();
+    #{align $ vsep binaryWriters}
 }
 |] where
   schemata = align $ vsep (map (\(k,t) -> t <+> k <> "_" <> ";") fields)
-  writers = map (\(k,_) -> dquotes ("\\\"" <> k <> "\\\"" <> ":")
-          <+> "<<" <+> [idoc|serialize(x.#{k}, #{k}_)|] ) fields
+  binaryWriters = [[idoc|binary_serialize(x.#{k}, #{k}_, buf);|] | (k,_) <- fields]
+  writers = map (\(k,_) -> vsep
+              [ "json +=" <+> dquotes ("\\\"" <> k <> "\\\"" <> ":") <> ";"
+              , [idoc|serialize(x.#{k}, #{k}_, json);|]
+              ]) fields
 
 
 
@@ -705,7 +856,7 @@ deserializerTemplate
 deserializerTemplate isObj params rtype fields
   = [idoc|
 #{makeTemplateHeader params}
-bool deserialize(const std::string json, size_t &i, #{rtype} &x){
+bool deserialize(const std::string &json, size_t &i, #{rtype} &x){
     #{schemata}
     try {
         whitespace(json, i);
@@ -722,8 +873,17 @@ bool deserialize(const std::string json, size_t &i, #{rtype} &x){
     #{assign}
     return true;
 }
+
+#{makeTemplateHeader params}
+bool binary_deserialize(const std::string &buf, size_t &i, #{rtype} &x){
+    #{schemata}
+    #{align $ vsep binaryParsers}
+    #{assign}
+    return true;
+}
 |] where
   schemata = align $ vsep (map (\(k,t) -> t <+> k <> "_" <> ";") fields)
+  binaryParsers = [[idoc|if(! binary_deserialize(buf, i, #{k}_)) return false;|] | (k,_) <- fields]
   fieldParsers = align $ vsep (punctuate parseComma (map (makeParseField . fst) fields))
   values = [k <> "_" | (k,_) <- fields]
   assign = if isObj
@@ -750,8 +910,8 @@ whitespace(json, i);|]
 
 
 
-makeMain :: [MDoc] -> [MDoc] -> [MDoc] -> [MDoc] -> MDoc -> MDoc
-makeMain includes signatures serialization manifolds dispatch = [idoc|#include <string>
+makeMain :: WireFormat -> Int -> (MDoc, Integer) -> MDoc -> MDoc -> [MDoc] -> [MDoc] -> [MDoc] -> [MDoc] -> MDoc -> MDoc
+makeMain wire threads (cacheDir, cacheLimit) programId labels includes signatures serialization manifolds dispatch = [idoc|#include <string>
 #include <iostream>
 #include <sstream>
 #include <functional>
@@ -759,9 +919,24 @@ makeMain includes signatures serialization manifolds dispatch = [idoc|#include <
 #include <string>
 #include <algorithm> // for std::transform
 
-#{Src.foreignCallFunction}
+#include "#{pretty Src.poolHeader}"
 
-#{Src.serializationHandling}
+// encoding used for data passed to other pools
+const morloc_wire_t _morloc_wire = #{wireName};
+
+// encoding used for the value returned to the caller, the nexus reads JSON
+morloc_wire_t _morloc_reply = MORLOC_WIRE_JSON;
+
+// maximum number of foreign calls that run at once
+const size_t _morloc_threads = #{pretty threads};
+
+// on-disk cache of the results returned to callers, a limit of 0 turns it off
+const char* _morloc_cache_dir = "#{cacheDir}";
+const uint64_t _morloc_cache_limit = #{pretty cacheLimit};
+const char* _morloc_program_id = "#{programId}";
+
+// the names under which manifold run times are recorded when profiling
+#{labels}
 
 #{vsep includes}
 
@@ -771,13 +946,29 @@ makeMain includes signatures serialization manifolds dispatch = [idoc|#include <
 
 #{vsep manifolds}
 
-int main(int argc, char * argv[])
+#{serialType} morloc_dispatch(int cmdID, const std::vector<std::string> &args)
 {
-    int cmdID;
     #{serialType} result;
-    cmdID = std::stoi(argv[1]);
     #{dispatch}
-    std::cout << result << std::endl;
+    return result;
+}
+
+int main(int argc, char * argv[])
+{
+    // a failed write to a dead callee is reported, it must not kill the pool
+    signal(SIGPIPE, SIG_IGN);
+    if(argc == 3 && strcmp(argv[1], "--daemon") == 0){
+        return pool_daemon(argv[2]);
+    }
+    if(argc == 2 && strcmp(argv[1], "--stdin") == 0){
+        return pool_stdin();
+    }
+    int cmdID = std::stoi(argv[1]);
+    std::vector<std::string> args(argv + 2, argv + argc);
+    std::cout << _morloc_cached(cmdID, args, morloc_dispatch) << std::endl;
     return 0;
 }
-|]
+|] where
+  wireName = case wire of
+    JsonWire -> "MORLOC_WIRE_JSON" :: MDoc
+    BinaryWire -> "MORLOC_WIRE_BINARY"
@@ -30,8 +30,8 @@ import qualified Data.Char as DC
 preprocess :: ExprM Many -> MorlocMonad (ExprM Many)
 preprocess = invertExprM
 
-translate :: [Source] -> [ExprM One] -> MorlocMonad MDoc
-translate srcs es = do
+translate :: MDoc -> [Source] -> [ExprM One] -> MorlocMonad MDoc
+translate programId srcs es = do
   -- setup library paths
   lib <- fmap pretty $ MM.asks MC.configLibrary
 
@@ -48,8 +48,13 @@ translate srcs es = do
 
   -- make code for dispatching to manifolds
   let dispatch = makeDispatch es
+      labels = makeProfileLabels es
 
-  return $ makePool lib includeDocs mDocs dispatch
+  wire <- MM.asks configWireFormat
+
+  cache <- resultCache
+
+  return $ makePool wire cache programId labels lib includeDocs mDocs dispatch
 
 -- create an internal variable based on a unique id
 letNamer :: Int -> MDoc
@@ -92,12 +97,16 @@ recordAccess record field = record <> "[" <> dquotes field <> "]"
 objectAccess :: MDoc -> MDoc -> MDoc
 objectAccess object field = object <> "." <> field
 
-serialize :: MDoc -> SerialAST One -> MorlocMonad (MDoc, [MDoc])
-serialize v0 s0 = do
+serialize
+  :: MDoc -- the wire format variable, @_morloc_wire@ or @_morloc_reply@
+  -> MDoc
+  -> SerialAST One
+  -> MorlocMonad (MDoc, [MDoc])
+serialize wire v0 s0 = do
   (ms, v1) <- serialize' v0 s0
   t <- serialAstToType s0
   schema <- typeSchema t
-  let v2 = "mlc_serialize" <> tupled [v1, schema]
+  let v2 = "_morloc_serialize" <> tupled [v1, schema, wire]
   return (v2, ms)
   where
     serialize' :: MDoc -> SerialAST One -> MorlocMonad ([MDoc], MDoc)
@@ -147,14 +156,14 @@ deserialize v0 s0
   | isSerializable s0 = do
       t <- serialAstToType s0
       schema <- typeSchema t
-      let deserializing = [idoc|mlc_deserialize(#{v0}, #{schema});|]
+      let deserializing = [idoc|_morloc_deserialize(#{v0}, #{schema});|]
       return (deserializing, [])
   | otherwise = do
       idx <- fmap pretty $ MM.getCounter
       t <- serialAstToType s0
       schema <- typeSchema t
       let rawvar = "s" <> idx
-          deserializing = [idoc|#{rawvar} = mlc_deserialize(#{v0}, #{schema});|]
+          deserializing = [idoc|#{rawvar} = _morloc_deserialize(#{v0}, #{schema});|]
       (x, befores) <- check rawvar s0
       return (x, deserializing:befores)
   where
@@ -211,6 +220,11 @@ translateManifold m0@(ManifoldM _ args0 _) = do
   (vsep . punctuate line . (\(x,_,_)->x)) <$> f args0 m0
   where
 
+  replies = replyIndices m0
+
+  wireOf :: Int -> MDoc
+  wireOf i = if elem i replies then "_morloc_reply" else "_morloc_wire"
+
   f :: [Argument]
     -> ExprM One
     -> MorlocMonad
@@ -221,21 +235,32 @@ translateManifold m0@(ManifoldM _ args0 _) = do
   f pargs m@(ManifoldM (metaId->i) args e) = do
     (ms', e', rs') <- f args e
     let mname = manNamer i
+        traced = "@_morloc_traced" <> parens (dquotes (pretty (traceName m)))
         def   = "def" <+> mname <> tupled (map makeArgument args) <> ":"
-        mdoc = nest 4 (vsep $ def:rs' ++ [e'])
+        mdoc = traced <> line <> nest 4 (vsep $ def:rs' ++ [e'])
     call <- return $ case (splitArgs args pargs, nargsTypeM (typeOfExprM m)) of
       ((rs, []), _) -> mname <> tupled (map makeArgument rs) -- covers #1, #2 and #4
       (([], _ ), _) -> mname
       ((rs, vs), _) -> makeLambda vs (mname <> tupled (map makeArgument (rs ++ vs))) -- covers #5
     return (mdoc : ms', call, [])
 
+  f _ (PoolCallM (Function _ _) _ _ _) = MM.throwError . OtherError $
+    "Foreign functions may only be passed as arguments to C++ functions"
+
   f _ (PoolCallM _ _ cmds args) = do
-    let call = "_morloc_foreign_call(" <> list(map dquotes cmds ++ map makeArgument args) <> ")"
+    let call = "_morloc_foreign_call" <> tupled [list (map dquotes cmds), list (map makeArgument args)]
     return ([], call, [])
 
   f _ (ForeignInterfaceM _ _) = MM.throwError . CallTheMonkeys $
     "Foreign interfaces should have been resolved before passed to the translators"
 
+  f args (LetM i (SerializeM s e1) e2) = do
+    (ms1', e1', rs1) <- f args e1
+    (serialized, rs2) <- serialize (wireOf i) e1' s
+    (ms2', e2', rs3) <- f args e2
+    let rs = rs1 ++ rs2 ++ [ letNamer i <+> "=" <+> serialized ] ++ rs3
+    return (ms1' ++ ms2', e2', rs)
+
   f args (LetM i e1 e2) = do
     (ms1', e1', rs1) <- (f args) e1
     (ms2', e2', rs2) <- (f args) e2
@@ -286,7 +311,7 @@ translateManifold m0@(ManifoldM _ args0 _) = do
 
   f args (SerializeM s e) = do
     (ms, e', rs1) <- f args e
-    (serialized, rs2) <- serialize e' s
+    (serialized, rs2) <- serialize "_morloc_wire" e' s
     return (ms, serialized, rs1 ++ rs2)
 
   f args (DeserializeM s e) = do
@@ -310,16 +335,22 @@ makeArgument (NativeArgument v _) = bndNamer v
 makeArgument (PassThroughArgument v) = bndNamer v
 
 makeDispatch :: [ExprM One] -> MDoc
-makeDispatch ms = align . vsep $
-  [ align . vsep $ ["dispatch = {", indent 4 (vsep $ map entry ms), "}"]
-  , "f = dispatch[cmdID]"
-  ]
+makeDispatch ms = align . vsep $ ["dispatch = {", indent 4 (vsep $ map entry ms), "}"]
   where
     entry :: ExprM One -> MDoc
     entry (ManifoldM (metaId->i) _ _)
       = pretty i <> ":" <+> manNamer i <> ","
     entry _ = error "Expected ManifoldM"
 
+-- | The names under which the run times of the root manifolds are profiled
+makeProfileLabels :: [ExprM One] -> MDoc
+makeProfileLabels ms = align . vsep $ ["_morloc_profile_labels = {", indent 4 (vsep $ mapMaybe entry ms), "}"]
+  where
+    entry :: ExprM One -> Maybe MDoc
+    entry m@(ManifoldM (metaId->i) _ _)
+      = (\label -> pretty i <> ":" <+> dquotes (pretty label) <> ",") <$> profileLabel m
+    entry _ = Nothing
+
 typeSchema :: TypeP -> MorlocMonad MDoc
 typeSchema t0 = f <$> type2jsontype t0
   where
@@ -342,12 +373,18 @@ typeSchema t0 = f <$> type2jsontype t0
     var :: MT.Text -> MDoc
     var v = dquotes (pretty v)
 
-makePool :: MDoc -> [MDoc] -> [MDoc] -> MDoc -> MDoc
-makePool lib includeDocs manifolds dispatch = [idoc|#!/usr/bin/env python
+makePool :: WireFormat -> (MDoc, Integer) -> MDoc -> MDoc -> MDoc -> [MDoc] -> [MDoc] -> MDoc -> MDoc
+makePool wire (cacheDir, cacheLimit) programId labels lib includeDocs manifolds dispatch = [idoc|#!/usr/bin/env python
 
 import sys
+import os
 import subprocess
 import json
+import struct
+import socket
+import select
+import time
+import hashlib
 from pymorlocinternals import (mlc_serialize, mlc_deserialize)
 from collections import OrderedDict
 
@@ -355,21 +392,506 @@ sys.path = ["#{lib}"] + sys.path
 
 #{vsep includeDocs}
 
-def _morloc_foreign_call(args):
+# encoding used for data passed to other pools
+_morloc_wire = "#{wireName}"
+
+# encoding used for the value returned to the caller, the nexus reads JSON
+_morloc_reply = "json"
+
+# on-disk cache of the results returned to callers, a limit of 0 turns it off
+_morloc_cache_dir = "#{cacheDir}"
+_morloc_cache_limit = #{pretty cacheLimit}
+_morloc_program_id = "#{programId}"
+
+# the names under which manifold run times are recorded when profiling
+#{labels}
+
+# When MORLOC_TRACE names a file, every manifold, serialization and foreign
+# call appends a Chrome trace event to it. The pool that a request from the
+# nexus reaches starts a trace: it creates the file with the opening bracket
+# of the event array if it does not exist yet, and names the trace. The name
+# is passed on with every foreign call, after the reply wire format and a
+# colon, so the events of all pools that served one command share it.
+_morloc_trace_file = os.environ.get("MORLOC_TRACE")
+_morloc_trace_id = None
+
+# microseconds of the wall clock, which all pools share
+def _morloc_trace_now():
+    return time.time_ns() // 1000
+
+# Start a trace for a request that came without one. No other pool serves
+# this request yet, so creating the file cannot race with their events.
+def _morloc_trace_root():
+    global _morloc_trace_id
+    _morloc_trace_id = "{}-{}".format(os.getpid(), _morloc_trace_now())
+    try:
+        fd = os.open(_morloc_trace_file, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o644)
+        os.write(fd, b"[\n")
+        os.close(fd)
+    except OSError:
+        pass
+
+# Append a complete event that started at `start`
+def _morloc_trace_event(name, cat, start, args):
+    event = {
+        "name": name,
+        "cat": cat,
+        "ph": "X",
+        "ts": start,
+        "dur": _morloc_trace_now() - start,
+        "pid": os.getpid(),
+        "tid": 0,
+        "args": dict(trace=_morloc_trace_id, **args)
+    }
+    # one write of an appended line, so events of concurrent pools do not mix
+    try:
+        fd = os.open(_morloc_trace_file, os.O_WRONLY | os.O_CREAT | os.O_APPEND, 0o644)
+        try:
+            os.write(fd, (json.dumps(event) + ",\n").encode("utf-8"))
+        finally:
+            os.close(fd)
+    except OSError:
+        pass
+
+# Record every call of a function, unless the pool is not traced. `size`, if
+# given, is the byte count of a call as a function of its arguments and result.
+def _morloc_traced(name, cat="manifold", size=None):
+    def wrap(f):
+        if _morloc_trace_file is None:
+            return f
+        def traced(*args):
+            start = _morloc_trace_now()
+            result = f(*args)
+            _morloc_trace_event(name, cat, start, {} if size is None else {"bytes": size(args, result)})
+            return result
+        return traced
+    return wrap
+
+# The binary wire format is driven by the same schemas as JSON. Integers are
+# written as 8-byte and reals as IEEE 8-byte little-endian values, booleans as
+# one byte, strings and lists as a 4-byte little-endian length followed by
+# their contents, and tuples and records as their fields in order. A binary
+# buffer travels between pools as its raw bytes, tagged with a leading '@'.
+#
+# Serialized data is held in str. It is converted from and to bytes with the
+# surrogateescape error handler, which keeps the bytes of binary data that are
+# not UTF-8 as lone surrogates, so every byte survives the round trip.
+def _morloc_text(data):
+    return data.decode("utf-8", "surrogateescape")
+
+def _morloc_bytes(x):
+    return x.encode("utf-8", "surrogateescape")
+
+_morloc_packed = {"int": "q", "float": "d"}
+
+def _morloc_binary_serialize(x, schema, buf):
+    (kind, args) = schema
+    if kind == "list":
+        buf += struct.pack("<I", len(x))
+        if args[1] is None and args[0] in _morloc_packed:
+            buf += struct.pack("<%d%s" % (len(x), _morloc_packed[args[0]]), *x)
+        else:
+            for xi in x:
+                _morloc_binary_serialize(xi, args, buf)
+    elif kind == "tuple":
+        for (xi, si) in zip(x, args):
+            _morloc_binary_serialize(xi, si, buf)
+    elif isinstance(args, OrderedDict):
+        for (k, si) in args.items():
+            xi = x[k] if kind in ("dict", "record") else getattr(x, k)
+            _morloc_binary_serialize(xi, si, buf)
+    elif kind == "float":
+        buf += struct.pack("<d", x)
+    elif kind == "int":
+        buf += struct.pack("<q", x)
+    elif kind == "bool":
+        buf += b"\x01" if x else b"\x00"
+    elif kind == "str":
+        data = x.encode("utf-8")
+        buf += struct.pack("<I", len(data))
+        buf += data
+    else:
+        raise TypeError("No binary encoding for type '{}'".format(kind))
+
+def _morloc_binary_deserialize(buf, i, schema):
+    (kind, args) = schema
+    if kind == "list":
+        (n,) = struct.unpack_from("<I", buf, i)
+        i += 4
+        if args[1] is None and args[0] in _morloc_packed:
+            code = _morloc_packed[args[0]]
+            x = list(struct.unpack_from("<%d%s" % (n, code), buf, i))
+            return (x, i + 8 * n)
+        x = []
+        for _ in range(n):
+            (xi, i) = _morloc_binary_deserialize(buf, i, args)
+            x.append(xi)
+        return (x, i)
+    elif kind == "tuple":
+        x = []
+        for si in args:
+            (xi, i) = _morloc_binary_deserialize(buf, i, si)
+            x.append(xi)
+        return (tuple(x), i)
+    elif isinstance(args, OrderedDict):
+        fields = OrderedDict()
+        for (k, si) in args.items():
+            (fields[k], i) = _morloc_binary_deserialize(buf, i, si)
+        if kind == "dict":
+            return (dict(fields), i)
+        elif kind == "record":
+            return (fields, i)
+        else:
+            return (kind(**fields), i)
+    elif kind == "float":
+        return (struct.unpack_from("<d", buf, i)[0], i + 8)
+    elif kind == "int":
+        return (struct.unpack_from("<q", buf, i)[0], i + 8)
+    elif kind == "bool":
+        return (buf[i] != 0, i + 1)
+    elif kind == "str":
+        (n,) = struct.unpack_from("<I", buf, i)
+        i += 4
+        return (bytes(buf[i:i+n]).decode("utf-8"), i + n)
+    else:
+        raise TypeError("No binary encoding for type '{}'".format(kind))
+
+@_morloc_traced("serialize", "serial", lambda args, data: len(data))
+def _morloc_serialize(x, schema, wire):
+    if wire == "binary":
+        buf = bytearray()
+        _morloc_binary_serialize(x, schema, buf)
+        return "@" + _morloc_text(bytes(buf))
+    return mlc_serialize(x, schema)
+
+@_morloc_traced("deserialize", "serial", lambda args, x: len(args[0]))
+def _morloc_deserialize(data, schema):
+    if data.startswith("@"):
+        buf = _morloc_bytes(data[1:])
+        return _morloc_binary_deserialize(memoryview(buf), 0, schema)[0]
+    return mlc_deserialize(data, schema)
+
+# Foreign calls never go through a shell. The callee is started directly and
+# the request is written to its stdin as a list of strings: a 4-byte
+# little-endian count followed by length-prefixed strings. A request holds the
+# manifold id, the wire format of the reply, and the arguments. The callee
+# writes the result to stdout.
+#
+# Pools may also run as daemons that serve the same requests over a Unix
+# socket. The nexus turns this on by exporting MORLOC_SOCKET_DIR, the
+# directory where the sockets live. A socket is named after its pool file. A
+# daemon reply is a list holding a status ("0" for success, "1" for an error
+# message) and the result.
+#
+# R cannot use Unix sockets, so daemons also listen on a TCP port of the
+# loopback interface. The port and a random token are written to the file
+# `<socket>.port`. A caller sends the token before its request, so only a
+# process that can read the socket directory is served. An R daemon has only
+# the port.
+#
+# A batch request runs a single-argument manifold on many values. Its manifold
+# id is prefixed with '*' and each argument is one value. The result is a
+# packed list holding a status and a result for every value.
+def _morloc_pack_strings(xs):
+    msg = bytearray(struct.pack("<I", len(xs)))
+    for x in xs:
+        data = x if isinstance(x, bytes) else _morloc_bytes(x)
+        msg += struct.pack("<I", len(data))
+        msg += data
+    return bytes(msg)
+
+# `read(n)` returns at most n bytes and an empty result at the end of input
+def _morloc_recv_exact(read, n):
+    data = bytearray()
+    while len(data) < n:
+        chunk = read(n - len(data))
+        if not chunk:
+            raise ConnectionError("Unexpected end of a pool message")
+        data += chunk
+    return data
+
+def _morloc_recv_strings(read):
+    take = lambda n: _morloc_recv_exact(read, n)
+    (n,) = struct.unpack("<I", take(4))
+    return [_morloc_text(take(struct.unpack("<I", take(4))[0])) for _ in range(n)]
+
+# Connect to the daemon at `path`, through its Unix socket or else through its
+# TCP port
+def _morloc_daemon_connect(path):
+    conn = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        conn.connect(path)
+        return conn
+    except OSError:
+        conn.close()
+    try:
+        with open(path + ".port") as fh:
+            (port, token) = fh.read().split()
+        conn = socket.create_connection(("127.0.0.1", int(port)))
+    except (OSError, ValueError):
+        return None
+    try:
+        conn.sendall(token.encode("ascii"))
+        return conn
+    except OSError:
+        conn.close()
+        return None
+
+# Connect to the daemon serving a pool, starting it if it is not running.
+# Returns None if the pool cannot run as a daemon.
+def _morloc_daemon_open(path, cmd):
+    conn = _morloc_daemon_connect(path)
+    if conn is not None or os.path.exists(path + ".nodaemon"):
+        return conn
+    daemon = subprocess.Popen(
+        cmd[:-1] + ["--daemon", path],
+        stdin=subprocess.DEVNULL,
+        stdout=subprocess.DEVNULL,
+        start_new_session=True
+    )
+    # wait for the daemon to listen, giving up if it exits first
+    for _ in range(3000):
+        conn = _morloc_daemon_connect(path)
+        if conn is not None or os.path.exists(path + ".nodaemon") or daemon.poll() is not None:
+            break
+        time.sleep(0.01)
+    return conn
+
+# When MORLOC_PROFILE names a file, every run of a labeled manifold appends a
+# line to it: the pool language, the label, the size of the arguments in bytes
+# and the wall time in nanoseconds. `morloc make --profile` reads these.
+def _morloc_profiled(mid, args, f):
+    profile = os.environ.get("MORLOC_PROFILE")
+    label = _morloc_profile_labels.get(mid)
+    if profile is None or label is None:
+        return str(f(*args))
+    size = sum(len(x) for x in args)
+    start = time.perf_counter_ns()
+    result = str(f(*args))
+    ns = time.perf_counter_ns() - start
+    # one write of an appended line, so lines of concurrent pools do not mix
+    try:
+        fd = os.open(profile, os.O_WRONLY | os.O_CREAT | os.O_APPEND, 0o644)
+        try:
+            os.write(fd, "python3\t{}\t{}\t{}\n".format(label, size, ns).encode("utf-8"))
+        finally:
+            os.close(fd)
+    except OSError:
+        pass
+    return result
+
+# Results of manifolds called by the nexus or by another pool may be cached on
+# disk. The key of an entry is the identity of the program build, the manifold
+# id, the reply wire format and the serialized arguments. An entry file is
+# named after a hash of the key and holds the key fields followed by the
+# result, so a hash collision is never taken for a hit. Once the cache grows
+# past its limit, the least recently used entries are removed.
+def _morloc_cached(mid, args, f):
+    if _morloc_trace_file is not None and _morloc_trace_id is None:
+        _morloc_trace_root()
+    if _morloc_cache_limit == 0:
+        return _morloc_profiled(mid, args, f)
+
+    key = [_morloc_program_id, str(mid), _morloc_reply] + list(args)
+    path = os.path.join(_morloc_cache_dir, hashlib.sha256(_morloc_pack_strings(key)).hexdigest())
+
+    try:
+        with open(path, "rb") as fh:
+            entry = _morloc_recv_strings(fh.read)
+        if entry[:-1] == key:
+            os.utime(path) # mark the entry as recently used
+            return entry[-1]
+    except (OSError, ConnectionError, struct.error, UnicodeDecodeError):
+        pass
+
+    result = _morloc_profiled(mid, args, f)
+
+    # write the entry to a private file and move it into place, so readers
+    # never see a partial entry
+    try:
+        os.makedirs(_morloc_cache_dir, exist_ok=True)
+        tmp = "{}.{}.tmp".format(path, os.getpid())
+        with open(tmp, "wb") as fh:
+            fh.write(_morloc_pack_strings(key + [result]))
+        os.replace(tmp, path)
+        _morloc_cache_evict()
+    except OSError:
+        pass
+    return result
+
+def _morloc_cache_evict():
+    entries = []
+    total = 0
+    for name in os.listdir(_morloc_cache_dir):
+        # skip entries that are still being written
+        if name.endswith(".tmp"):
+            continue
+        try:
+            st = os.stat(os.path.join(_morloc_cache_dir, name))
+        except OSError:
+            continue
+        entries.append((st.st_mtime, st.st_size, name))
+        total += st.st_size
+    for (_, size, name) in sorted(entries):
+        if total <= _morloc_cache_limit:
+            break
+        try:
+            os.unlink(os.path.join(_morloc_cache_dir, name))
+        except OSError:
+            pass
+        total -= size
+
+# Run a request read from a caller: the manifold id, the reply wire format and
+# the arguments
+def _morloc_serve(request, dispatch):
+    global _morloc_reply, _morloc_trace_id
+    # a traced caller appends the trace id to the wire format
+    (_morloc_reply, _, trace) = request[1].partition(":")
+    if trace:
+        _morloc_trace_id = trace
+    if request[0].startswith("*"):
+        # the vectorized entry point, each argument is one call
+        mid = int(request[0][1:])
+        f = dispatch[mid]
+        replies = []
+        for x in request[2:]:
+            try:
+                replies += ["0", _morloc_cached(mid, [x], f)]
+            except BaseException as e:
+                replies += ["1", str(e)]
+        return _morloc_pack_strings(replies)
+    mid = int(request[0])
+    return _morloc_bytes(_morloc_cached(mid, request[2:], dispatch[mid]))
+
+# Wait for any request children of a daemon that have finished
+def _morloc_reap():
+    try:
+        while os.waitpid(-1, os.WNOHANG)[0] > 0:
+            pass
+    except ChildProcessError:
+        pass
+
+# Listen on a free TCP port of the loopback interface and write the port and a
+# random token to `<path>.port`. Returns the listening socket and the token,
+# or None if the daemon is reachable only through its Unix socket.
+def _morloc_daemon_listen_port(path):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    try:
+        server.bind(("127.0.0.1", 0))
+        server.listen(64)
+        token = os.urandom(16).hex()
+        # written to a private file and moved into place, so callers never
+        # read a partial port file
+        with open(path + ".port.tmp", "w") as fh:
+            print(server.getsockname()[1], token, file=fh)
+        os.replace(path + ".port.tmp", path + ".port")
+        return (server, token)
+    except OSError:
+        server.close()
+        return (None, None)
+
+# The server loop of a pool daemon. Each request is handled in a forked child,
+# so a daemon may be re-entered by the calls it makes to other pools. It
+# serves until the socket is removed, which the nexus does on exit.
+def _morloc_daemon(path, dispatch):
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    try:
+        server.bind(path)
+    except OSError:
+        # another daemon may already be serving this pool
+        conn = _morloc_daemon_connect(path)
+        if conn is not None:
+            conn.close()
+            return
+        os.unlink(path)
+        server.bind(path)
+    server.listen(64)
+    with open(path + ".pid", "w") as fh:
+        print(os.getpid(), file=fh)
+    (inet, token) = _morloc_daemon_listen_port(path)
+    # Finished request children are reaped here rather than by ignoring
+    # SIGCHLD, since an ignored SIGCHLD is inherited by the children, whose
+    # foreign calls then cannot get the exit status of their callees.
+    while os.path.exists(path):
+        _morloc_reap()
+        (ready, _, _) = select.select([x for x in (server, inet) if x], [], [], 1.0)
+        if not ready:
+            continue
+        (conn, _) = ready[0].accept()
+        if os.fork() == 0:
+            server.close()
+            if inet:
+                inet.close()
+            try:
+                # a TCP caller must send the token first
+                if ready[0] is inet and _morloc_recv_exact(conn.recv, len(token)) != token.encode("ascii"):
+                    return
+                result = _morloc_serve(_morloc_recv_strings(conn.recv), dispatch)
+                conn.sendall(_morloc_pack_strings(["0", result]))
+            except BaseException as e:
+                conn.sendall(_morloc_pack_strings(["1", str(e)]))
+            finally:
+                conn.close()
+                os._exit(0)
+        conn.close()
+
+# The last element of `cmd` is the manifold id. The callee is asked to reply in
+# this pool's wire format.
+def _morloc_foreign_call(cmd, args):
+    if _morloc_trace_file is None:
+        return _morloc_send_request(cmd, [cmd[-1], _morloc_wire] + args)
+    start = _morloc_trace_now()
+    result = _morloc_send_request(cmd, [cmd[-1], _morloc_wire + ":" + _morloc_trace_id] + args)
+    _morloc_trace_event("foreign_call", "foreign", start, {
+        "pool": cmd[-2],
+        "manifold": cmd[-1],
+        "sent": sum(len(_morloc_bytes(x)) for x in args),
+        "received": len(_morloc_bytes(result))
+    })
+    return result
+
+# Send a request to the pool started by `cmd`, through its daemon if pools run
+# as daemons
+def _morloc_send_request(cmd, request):
+    request = _morloc_pack_strings(request)
+
+    if "MORLOC_SOCKET_DIR" in os.environ:
+        path = os.path.join(os.environ["MORLOC_SOCKET_DIR"], os.path.basename(cmd[-2]))
+        conn = _morloc_daemon_open(path, cmd)
+        if conn is not None:
+            with conn:
+                conn.sendall(request)
+                (status, result) = _morloc_recv_strings(conn.recv)
+            if status != "0":
+                sys.exit(result)
+            return result
+
     try:
         sysObj = subprocess.run(
-            args,
+            cmd[:-1] + ["--stdin"],
+            input=request,
             stdout=subprocess.PIPE,
             check=True
         )
     except subprocess.CalledProcessError as e:
         sys.exit(str(e))
 
-    return(sysObj.stdout.decode("ascii"))
+    return(_morloc_text(sysObj.stdout))
 
 #{vsep manifolds}
 
 if __name__ == '__main__':
+    #{dispatch}
+
+    if len(sys.argv) == 3 and sys.argv[1] == "--daemon":
+        _morloc_daemon(sys.argv[2], dispatch)
+        sys.exit(0)
+
+    if len(sys.argv) == 2 and sys.argv[1] == "--stdin":
+        request = _morloc_recv_strings(sys.stdin.buffer.read)
+        sys.stdout.buffer.write(_morloc_serve(request, dispatch))
+        sys.exit(0)
+
     try:
         cmdID = int(sys.argv[1])
     except IndexError:
@@ -377,11 +899,14 @@ if __name__ == '__main__':
     except ValueError:
         sys.exit("Internal error in {}: expected integer manifold id".format(sys.argv[0]))
     try:
-        #{dispatch}
+        f = dispatch[cmdID]
     except KeyError:
         sys.exit("Internal error in {}: no manifold found with id={}".format(sys.argv[0], cmdID))
 
-    result = f(*sys.argv[2:])
+    result = _morloc_cached(cmdID, sys.argv[2:], f)
 
     print(result)
-|]
+|] where
+  wireName = case wire of
+    JsonWire -> "json" :: MDoc
+    BinaryWire -> "binary"
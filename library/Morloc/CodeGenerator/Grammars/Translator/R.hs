@@ -27,8 +27,8 @@ import qualified Morloc.Data.Text as MT
 preprocess :: ExprM Many -> MorlocMonad (ExprM Many)
 preprocess = invertExprM
 
-translate :: [Source] -> [ExprM One] -> MorlocMonad MDoc
-translate srcs es = do
+translate :: MDoc -> [Source] -> [ExprM One] -> MorlocMonad MDoc
+translate programId srcs es = do
   -- translate sources
   includeDocs <- mapM
     translateSource
@@ -40,7 +40,22 @@ translate srcs es = do
   -- translate each manifold tree, rooted on a call from nexus or another pool
   mDocs <- mapM translateManifold es
 
-  return $ makePool includeDocs mDocs
+  wire <- MM.asks configWireFormat
+
+  cache <- resultCache
+
+  return $ makePool wire cache programId (makeProfileLabels es) includeDocs mDocs
+
+-- | The names under which the run times of the root manifolds are profiled
+makeProfileLabels :: [ExprM One] -> MDoc
+makeProfileLabels ms = case mapMaybe entry ms of
+  [] -> "character(0)"
+  entries -> "c" <> tupled entries
+  where
+    entry :: ExprM One -> Maybe MDoc
+    entry m@(ManifoldM (metaId->i) _ _)
+      = (\label -> dquotes (pretty i) <> "=" <> dquotes (pretty label)) <$> profileLabel m
+    entry _ = Nothing
 
 letNamer :: Int -> MDoc 
 letNamer i = "a" <> viaShow i
@@ -62,12 +77,16 @@ tupleKey i v = [idoc|#{v}[[#{pretty i}]]|]
 recordAccess :: MDoc -> MDoc -> MDoc
 recordAccess record field = record <> "$" <> field
 
-serialize :: MDoc -> SerialAST One -> MorlocMonad (MDoc, [MDoc])
-serialize v0 s0 = do
+serialize
+  :: MDoc -- the wire format variable, @.morloc_wire@ or @.morloc_reply@
+  -> MDoc
+  -> SerialAST One
+  -> MorlocMonad (MDoc, [MDoc])
+serialize wire v0 s0 = do
   (ms, v1) <- serialize' v0 s0
   t <- serialAstToType s0
   schema <- typeSchema t
-  let v2 = "rmorlocinternals::mlc_serialize" <> tupled [v1, schema]
+  let v2 = ".morloc_serialize" <> tupled [v1, schema, wire]
   return (v2, ms)
   where
     serialize' :: MDoc -> SerialAST One -> MorlocMonad ([MDoc], MDoc)
@@ -113,14 +132,14 @@ deserialize v0 s0
   | isSerializable s0 = do
       t <- serialAstToType s0
       schema <- typeSchema t
-      let deserializing = [idoc|rmorlocinternals::mlc_deserialize(#{v0}, #{schema});|]
+      let deserializing = [idoc|.morloc_deserialize(#{v0}, #{schema});|]
       return (deserializing, [])
   | otherwise = do
       idx <- fmap pretty $ MM.getCounter
       t <- serialAstToType s0
       schema <- typeSchema t
       let rawvar = "s" <> idx
-          deserializing = [idoc|#{rawvar} <- rmorlocinternals::mlc_deserialize(#{v0}, #{schema});|]
+          deserializing = [idoc|#{rawvar} <- .morloc_deserialize(#{v0}, #{schema});|]
       (x, befores) <- check rawvar s0
       return (x, deserializing:befores)
   where
@@ -172,13 +191,18 @@ translateManifold m0@(ManifoldM _ args0 _) = do
   (vsep . punctuate line . (\(x,_,_)->x)) <$> f args0 m0
   where
 
+  replies = replyIndices m0
+
+  wireOf :: Int -> MDoc
+  wireOf i = if elem i replies then ".morloc_reply" else ".morloc_wire"
 
   f :: [Argument] -> ExprM One -> MorlocMonad ([MDoc], MDoc, [MDoc])
   f pargs m@(ManifoldM (metaId->i) args e) = do
     (ms', body, rs') <- f args e
     let decl = manNamer i <+> "<- function" <> tupled (map makeArgument args)
-        mdoc = block 4 decl (vsep $ rs' ++ [body])
         mname = manNamer i
+        traced = mname <+> "<-" <+> ".morloc_traced" <> tupled [dquotes (pretty (traceName m)), mname]
+        mdoc = vsep [block 4 decl (vsep $ rs' ++ [body]), traced]
     -- TODO: handle partials BEFORE translation
     call <- return $ case (splitArgs args pargs, nargsTypeM (typeOfExprM m)) of
       ((rs, []), _) -> mname <> tupled (map makeArgument rs) -- covers #1, #2 and #4
@@ -186,15 +210,25 @@ translateManifold m0@(ManifoldM _ args0 _) = do
       ((rs, vs), _) -> makeLambda vs (mname <> tupled (map makeArgument (rs ++ vs))) -- covers #5
     return (mdoc : ms', call, [])
 
+  f _ (PoolCallM (Function _ _) _ _ _) = MM.throwError . OtherError $
+    "Foreign functions may only be passed as arguments to C++ functions"
+
   f _ (PoolCallM _ _ cmds args) = do
     let quotedCmds = map dquotes cmds
-        callArgs = "list(" <> hsep (punctuate "," (drop 1 quotedCmds ++ map makeArgument args)) <> ")"
-        call = ".morloc_foreign_call" <> tupled([head quotedCmds, callArgs, dquotes "_", dquotes "_"])
+        callArgs = "list(" <> hsep (punctuate "," (map makeArgument args)) <> ")"
+        call = ".morloc_foreign_call" <> tupled(["c" <> tupled quotedCmds, callArgs, dquotes "_", dquotes "_"])
     return ([], call, [])
 
   f _ (ForeignInterfaceM _ _) = MM.throwError . CallTheMonkeys $
     "Foreign interfaces should have been resolved before passed to the translators"
 
+  f args (LetM i (SerializeM s e1) e2) = do
+    (ms1', e1', rs1) <- f args e1
+    (serialized, rs2) <- serialize (wireOf i) e1' s
+    (ms2', e2', rs3) <- f args e2
+    let rs = rs1 ++ rs2 ++ [ letNamer i <+> "<-" <+> serialized ] ++ rs3
+    return (ms1' ++ ms2', e2', rs)
+
   f args (LetM i e1 e2) = do
     (ms1', e1', rs1) <- (f args) e1
     (ms2', e2', rs2) <- (f args) e2
@@ -252,7 +286,7 @@ translateManifold m0@(ManifoldM _ args0 _) = do
 
   f args (SerializeM s e) = do
     (ms, e', rs1) <- f args e
-    (serialized, rs2) <- serialize e' s
+    (serialized, rs2) <- serialize ".morloc_wire" e' s
     return (ms, serialized, rs1 ++ rs2)
 
   f args (DeserializeM s e) = do
@@ -295,11 +329,241 @@ jsontype2rjson (NamJ objType rs) =
   vals = map jsontype2rjson (map snd rs)
   rs' = zipWith (\key val -> key <> ":" <> val) keys vals
 
-makePool :: [MDoc] -> [MDoc] -> MDoc
-makePool sources manifolds = [idoc|#!/usr/bin/env Rscript
+makePool :: WireFormat -> (MDoc, Integer) -> MDoc -> MDoc -> [MDoc] -> [MDoc] -> MDoc
+makePool wire (cacheDir, cacheLimit) programId labels sources manifolds = [idoc|#!/usr/bin/env Rscript
 
 #{vsep sources}
 
+# encoding used for data passed to other pools
+.morloc_wire <- "#{wireName}"
+
+# encoding used for the value returned to the caller, the nexus reads JSON
+.morloc_reply <- "json"
+
+# on-disk cache of the results returned to callers, a limit of 0 turns it off
+.morloc_cache_dir <- "#{cacheDir}"
+.morloc_cache_limit <- #{pretty cacheLimit}
+.morloc_program_id <- "#{programId}"
+
+# the names under which manifold run times are recorded when profiling
+.morloc_profile_labels <- #{labels}
+
+# When MORLOC_TRACE names a file, every manifold, serialization and foreign
+# call appends a Chrome trace event to it. The pool that a request from the
+# nexus reaches starts a trace: it creates the file with the opening bracket
+# of the event array if it does not exist yet, and names the trace. The name
+# is passed on with every foreign call, after the reply wire format and a
+# colon, so the events of all pools that served one command share it.
+.morloc_trace_file <- Sys.getenv("MORLOC_TRACE")
+.morloc_trace_id <- ""
+
+# microseconds of the wall clock, which all pools share
+.morloc_trace_now <- function(){
+  floor(as.numeric(Sys.time()) * 1e6)
+}
+
+# Start a trace for a request that came without one. No other pool serves
+# this request yet, so creating the file cannot race with their events.
+.morloc_trace_root <- function(){
+  .morloc_trace_id <<- sprintf("%d-%.0f", Sys.getpid(), .morloc_trace_now())
+  # the file is created exclusively, so a pool starting another trace at the
+  # same moment cannot write the bracket twice or truncate the events
+  tryCatch({
+    con <- file(.morloc_trace_file, open="wx")
+    cat("[\n", file=con)
+    close(con)
+  }, warning=function(w) NULL, error=function(e) NULL)
+}
+
+# Append a complete event that started at `start`
+.morloc_trace_event <- function(name, category, start, args=list()){
+  args <- c(list(trace=.morloc_trace_id), args)
+  fields <- vapply(names(args), function(k){
+    v <- args[[k]]
+    value <- if(is.character(v)) jsonlite::toJSON(v, auto_unbox=TRUE) else sprintf("%.0f", v)
+    sprintf('"%s":%s', k, value)
+  }, character(1))
+  line <- sprintf(
+    '{"name":%s,"cat":"%s","ph":"X","ts":%.0f,"dur":%.0f,"pid":%d,"tid":0,"args":{%s}},\n',
+    jsonlite::toJSON(name, auto_unbox=TRUE), category, start,
+    .morloc_trace_now() - start, Sys.getpid(), paste(fields, collapse=",")
+  )
+  cat(line, file=.morloc_trace_file, append=TRUE)
+}
+
+# Record every call of a function, unless the pool is not traced. `size`, if
+# given, is the byte count of a call as a function of its arguments and result.
+.morloc_traced <- function(name, f, category="manifold", size=NULL){
+  if(.morloc_trace_file == ""){
+    return(f)
+  }
+  function(...){
+    start <- .morloc_trace_now()
+    result <- f(...)
+    bytes <- if(is.null(size)) list() else list(bytes=size(list(...), result))
+    .morloc_trace_event(name, category, start, bytes)
+    result
+  }
+}
+
+# The binary wire format is driven by the same schemas as JSON. Integers are
+# written as 8-byte and reals as IEEE 8-byte little-endian values, booleans as
+# one byte, strings and lists as a 4-byte little-endian length followed by
+# their contents, and tuples and records as their fields in order. A binary
+# buffer travels between pools as its raw bytes, tagged with a leading '@'.
+#
+# R strings cannot hold every byte, so serialized data is a string for JSON
+# and a raw vector, starting with the '@' tag, for binary data.
+.morloc_schemas <- new.env()
+
+.morloc_to_raw <- function(x){
+  if(is.raw(x)) x else charToRaw(enc2utf8(x))
+}
+
+.morloc_from_raw <- function(data){
+  if(length(data) > 0 && data[1] == charToRaw("@")) data else rawToChar(data)
+}
+
+# the number of bytes in serialized data
+.morloc_size <- function(x){
+  if(is.raw(x)) length(x) else sum(nchar(x, type="bytes"))
+}
+
+.morloc_schema <- function(schema){
+  if(is.null(.morloc_schemas[[schema]])){
+    assign(schema, jsonlite::fromJSON(schema, simplifyVector=FALSE), envir=.morloc_schemas)
+  }
+  .morloc_schemas[[schema]]
+}
+
+.morloc_write_length <- function(n){
+  writeBin(as.integer(n), raw(), size=4, endian="little")
+}
+
+# write a vector of primitive values
+.morloc_write_leaves <- function(x, type){
+  switch(type,
+    numeric = writeBin(as.double(x), raw(), size=8, endian="little"),
+    integer = {
+      # integers past 32 bits are held in doubles, the word 0x80000000 is
+      # written from NA
+      x <- as.double(x)
+      high <- floor(x / 2^32)
+      low <- x - high * 2^32
+      low <- ifelse(low >= 2^31, low - 2^32, low)
+      writeBin(suppressWarnings(as.integer(rbind(low, high))), raw(), size=4, endian="little")
+    },
+    logical = as.raw(as.logical(x)),
+    character = do.call(c, lapply(x, function(s){
+      b <- charToRaw(enc2utf8(s))
+      c(.morloc_write_length(length(b)), b)
+    })),
+    stop("No binary encoding for type '", type, "'")
+  )
+}
+
+.morloc_binary_serialize <- function(x, schema){
+  if(is.character(schema)){
+    return(.morloc_write_leaves(x, schema))
+  }
+  kind <- names(schema)[1]
+  if(kind == "data.frame"){
+    stop("No binary encoding for data frames")
+  } else if(kind == "list"){
+    element <- schema[[1]][[1]]
+    if(is.character(element)){
+      c(.morloc_write_length(length(x)), .morloc_write_leaves(unlist(x), element))
+    } else {
+      c(.morloc_write_length(length(x)), do.call(c, lapply(x, .morloc_binary_serialize, element)))
+    }
+  } else if(kind == "tuple"){
+    do.call(c, Map(.morloc_binary_serialize, x, schema[[1]]))
+  } else {
+    fields <- if(kind == "record") schema[[1]] else schema
+    do.call(c, lapply(names(fields), function(k) .morloc_binary_serialize(x[[k]], fields[[k]])))
+  }
+}
+
+# Read n 8-byte integers. R integers have 32 bits, so the values are integers
+# if they all fit and doubles otherwise, which are exact up to 2^53.
+.morloc_read_int64 <- function(buf, n){
+  words <- readBin(buf, "integer", n=2 * n, size=4, endian="little")
+  # the low word is unsigned, and the word 0x80000000 is read as NA
+  low <- words[seq_len(n) * 2 - 1]
+  low <- ifelse(is.na(low), 2^31, ifelse(low < 0, low + 2^32, as.double(low)))
+  high <- words[seq_len(n) * 2]
+  high <- ifelse(is.na(high), -2^31, as.double(high))
+  x <- high * 2^32 + low
+  if(all(abs(x) < 2^31)) as.integer(x) else x
+}
+
+.morloc_binary_deserialize <- function(buf, schema){
+  i <- 1
+  take <- function(n){
+    x <- buf[seq_len(n) + (i - 1)]
+    i <<- i + n
+    x
+  }
+  count <- function(){
+    readBin(take(4), "integer", size=4, endian="little")
+  }
+  leaves <- function(type, n){
+    switch(type,
+      numeric = readBin(take(8 * n), "double", n=n, size=8, endian="little"),
+      integer = .morloc_read_int64(take(8 * n), n),
+      logical = as.logical(take(n)),
+      character = vapply(seq_len(n), function(k) rawToChar(take(count())), ""),
+      stop("No binary encoding for type '", type, "'")
+    )
+  }
+  walk <- function(schema){
+    if(is.character(schema)){
+      return(leaves(schema, 1))
+    }
+    kind <- names(schema)[1]
+    if(kind == "data.frame"){
+      stop("No binary encoding for data frames")
+    } else if(kind == "list"){
+      element <- schema[[1]][[1]]
+      n <- count()
+      if(is.character(element)){
+        leaves(element, n)
+      } else {
+        lapply(seq_len(n), function(k) walk(element))
+      }
+    } else if(kind == "tuple"){
+      lapply(schema[[1]], walk)
+    } else if(kind == "record"){
+      lapply(schema[[1]], walk)
+    } else {
+      lapply(schema, walk)
+    }
+  }
+  walk(schema)
+}
+
+.morloc_serialize <- function(x, schema, wire){
+  if(wire == "binary"){
+    c(charToRaw("@"), .morloc_binary_serialize(x, .morloc_schema(schema)))
+  } else {
+    rmorlocinternals::mlc_serialize(x, schema)
+  }
+}
+
+.morloc_deserialize <- function(data, schema){
+  if(is.raw(data)){
+    .morloc_binary_deserialize(data[-1], .morloc_schema(schema))
+  } else {
+    rmorlocinternals::mlc_deserialize(data, schema)
+  }
+}
+
+.morloc_serialize <- .morloc_traced("serialize", .morloc_serialize, "serial",
+  function(args, data) .morloc_size(data))
+
+.morloc_deserialize <- .morloc_traced("deserialize", .morloc_deserialize, "serial",
+  function(args, x) .morloc_size(args[[1]]))
+
 .morloc_run <- function(f, args){
   fails <- ""
   isOK <- TRUE
@@ -359,8 +623,323 @@ makePool sources manifolds = [idoc|#!/usr/bin/env Rscript
   return(x)
 }
 
+# A request to another pool is a list of strings: a 4-byte little-endian count
+# followed by length-prefixed strings. It holds the manifold id, the wire
+# format of the reply, and the arguments. The callee reads it from stdin, so
+# no data is passed on the command line. A batch request runs a
+# single-argument manifold on many values, its manifold id is prefixed with
+# '*' and the result is a packed list of a status and a result per value.
+# The strings are held in a list, since binary data is a raw vector.
+#
+# Pools may also run as daemons that serve the same requests over a socket.
+# The nexus turns this on by exporting MORLOC_SOCKET_DIR, the directory where
+# the sockets live. A socket is named after its pool file. R cannot use Unix
+# sockets, so it reaches a daemon through the TCP port that the daemon writes
+# to `<socket>.port` along with a random token, and sends the token before
+# its request. A daemon reply is a list holding a status ("0" for success,
+# "1" for an error message) and the result.
+.morloc_write_strings <- function(xs, con){
+  writeBin(length(xs), con, size=4, endian="little")
+  for(x in xs){
+    data <- .morloc_to_raw(x)
+    writeBin(length(data), con, size=4, endian="little")
+    writeBin(data, con)
+  }
+}
+
+.morloc_read_strings <- function(con){
+  n <- readBin(con, "integer", size=4, endian="little")
+  lapply(seq_len(n), function(i){
+    size <- readBin(con, "integer", size=4, endian="little")
+    .morloc_from_raw(.morloc_read_exact(con, size))
+  })
+}
+
+# a socket may return fewer bytes than were asked for
+.morloc_read_exact <- function(con, n){
+  data <- readBin(con, "raw", n=n)
+  while(length(data) < n){
+    more <- readBin(con, "raw", n=n - length(data))
+    if(length(more) == 0){
+      stop("Unexpected end of a pool message")
+    }
+    data <- c(data, more)
+  }
+  data
+}
+
+# When MORLOC_PROFILE names a file, every run of a labeled manifold appends a
+# line to it: the pool language, the label, the size of the arguments in bytes
+# and the wall time in nanoseconds. `morloc make --profile` reads these.
+.morloc_profiled <- function(mid, args, f){
+  profile <- Sys.getenv("MORLOC_PROFILE")
+  label <- unname(.morloc_profile_labels[as.character(mid)])
+  if(profile == "" || is.na(label)){
+    return(do.call(f, args))
+  }
+  size <- sum(vapply(args, .morloc_size, 0))
+  start <- proc.time()[["elapsed"]]
+  result <- do.call(f, args)
+  ns <- (proc.time()[["elapsed"]] - start) * 1e9
+  cat(sprintf("R\t%s\t%.0f\t%.0f\n", label, size, ns), file=profile, append=TRUE)
+  result
+}
+
+# Results of manifolds called by the nexus or by another pool may be cached on
+# disk. The key of an entry is the identity of the program build, the manifold
+# id, the reply wire format and the serialized arguments. An entry file is
+# named after a hash of the key and holds the key fields followed by the
+# result, so a hash collision is never taken for a hit. Once the cache grows
+# past its limit, the least recently used entries are removed.
+.morloc_cached <- function(mid, args, f){
+  if(.morloc_trace_file != "" && .morloc_trace_id == ""){
+    .morloc_trace_root()
+  }
+  if(.morloc_cache_limit == 0){
+    return(.morloc_profiled(mid, args, f))
+  }
+
+  key <- c(list(.morloc_program_id, as.character(mid), .morloc_reply), args)
+  keyfile <- tempfile()
+  on.exit(unlink(keyfile))
+  con <- file(keyfile, "wb")
+  .morloc_write_strings(key, con)
+  close(con)
+  path <- file.path(.morloc_cache_dir, unname(tools::md5sum(keyfile)))
+
+  if(file.exists(path)){
+    con <- file(path, "rb")
+    entry <- tryCatch(.morloc_read_strings(con), error=function(e) list())
+    close(con)
+    n <- length(key)
+    if(length(entry) == n + 1 && identical(entry[seq_len(n)], key)){
+      Sys.setFileTime(path, Sys.time()) # mark the entry as recently used
+      return(entry[[n + 1]])
+    }
+  }
+
+  result <- .morloc_profiled(mid, args, f)
+
+  # write the entry to a private file and move it into place, so readers
+  # never see a partial entry
+  dir.create(.morloc_cache_dir, recursive=TRUE, showWarnings=FALSE)
+  tmp <- paste0(path, ".", Sys.getpid(), ".tmp")
+  con <- file(tmp, "wb")
+  .morloc_write_strings(c(key, list(result)), con)
+  close(con)
+  file.rename(tmp, path)
+  .morloc_cache_evict()
+  result
+}
+
+.morloc_cache_evict <- function(){
+  files <- list.files(.morloc_cache_dir, full.names=TRUE)
+  # skip entries that are still being written
+  info <- file.info(files[!endsWith(files, ".tmp")])
+  info <- info[!is.na(info$size), ]
+  info <- info[order(info$mtime), ]
+  excess <- sum(info$size) - .morloc_cache_limit
+  if(excess > 0){
+    # remove the oldest entries until the rest fit in the limit
+    unlink(rownames(info)[cumsum(info$size) - info$size < excess])
+  }
+}
+
+# the seconds a daemon connection may wait, longer than any manifold runs
+.morloc_socket_timeout <- 1e7
+
+# Connect to the daemon at `path` through the port and token written to
+# `path.port`. Returns NULL if no daemon is listening.
+.morloc_daemon_connect <- function(path){
+  portfile <- paste0(path, ".port")
+  if(! file.exists(portfile)){
+    return(NULL)
+  }
+  fields <- strsplit(readLines(portfile, n=1, warn=FALSE), " ", fixed=TRUE)[[1]]
+  if(length(fields) != 2){
+    return(NULL)
+  }
+  con <- tryCatch(
+    suppressWarnings(socketConnection(
+      "127.0.0.1", as.integer(fields[1]), blocking=TRUE, open="r+b",
+      timeout=.morloc_socket_timeout
+    )),
+    error=function(e) NULL
+  )
+  if(! is.null(con)){
+    writeBin(charToRaw(fields[2]), con)
+  }
+  con
+}
+
+# Connect to the daemon serving a pool, starting it if it is not running.
+# Returns NULL if the pool cannot run as a daemon. The last element of `cmd`
+# is the manifold id and is dropped.
+.morloc_daemon_open <- function(path, cmd){
+  nodaemon <- paste0(path, ".nodaemon")
+  con <- .morloc_daemon_connect(path)
+  if(! is.null(con) || file.exists(nodaemon)){
+    return(con)
+  }
+  n <- length(cmd)
+  system2(cmd[1], args=c(cmd[c(-1, -n)], "--daemon", path), stdin="/dev/null", stdout=FALSE, wait=FALSE)
+  # wait for the daemon to listen, the exit of a daemon that failed to start
+  # is not seen, so this gives up after 30 seconds
+  for(i in 1:3000){
+    con <- .morloc_daemon_connect(path)
+    if(! is.null(con) || file.exists(nodaemon)){
+      break
+    }
+    Sys.sleep(0.01)
+  }
+  con
+}
+
+# The last element of `cmd` is the manifold id. The callee is asked to reply in
+# this pool's wire format.
 .morloc_foreign_call <- function(cmd, args, .pool, .name){
-  .morloc_try(f=system2, args=list(cmd, args=args, stdout=TRUE), .pool=.pool, .name=.name)
+  n <- length(cmd)
+  traced <- .morloc_trace_file != ""
+  wire <- if(traced) paste0(.morloc_wire, ":", .morloc_trace_id) else .morloc_wire
+  start <- .morloc_trace_now()
+  result <- .morloc_send_request(cmd, c(list(cmd[n], wire), args), .pool, .name)
+  if(traced){
+    .morloc_trace_event("foreign_call", "foreign", start, list(
+      pool=cmd[n - 1],
+      manifold=cmd[n],
+      sent=sum(vapply(args, .morloc_size, 0)),
+      received=.morloc_size(result)
+    ))
+  }
+  result
+}
+
+# Send a request to the pool started by `cmd`, through its daemon if pools run
+# as daemons
+.morloc_send_request <- function(cmd, request, .pool, .name){
+  n <- length(cmd)
+  socket_dir <- Sys.getenv("MORLOC_SOCKET_DIR")
+  if(socket_dir != ""){
+    con <- .morloc_daemon_open(file.path(socket_dir, basename(cmd[n - 1])), cmd)
+    if(! is.null(con)){
+      .morloc_write_strings(request, con)
+      reply <- .morloc_read_strings(con)
+      close(con)
+      if(reply[[1]] != "0"){
+        stop(reply[[2]])
+      }
+      return(reply[[2]])
+    }
+  }
+
+  requestfile <- tempfile()
+  on.exit(unlink(requestfile))
+  con <- file(requestfile, "wb")
+  .morloc_write_strings(request, con)
+  close(con)
+  # the reply is read from a file, since binary data is not text
+  output <- tempfile()
+  on.exit(unlink(output), add=TRUE)
+  .morloc_try(
+    f=system2,
+    args=list(cmd[1], args=c(cmd[c(-1, -n)], "--stdin"), stdin=requestfile, stdout=output),
+    .pool=.pool,
+    .name=.name
+  )
+  .morloc_from_raw(readBin(output, "raw", n=file.size(output)))
+}
+
+# Run a request read from a caller: the manifold id, the reply wire format and
+# the arguments. The reply is returned as a raw vector.
+.morloc_serve <- function(request){
+  # a traced caller appends the trace id to the wire format
+  wire <- strsplit(request[[2]], ":", fixed=TRUE)[[1]]
+  .morloc_reply <<- wire[1]
+  if(length(wire) > 1){
+    .morloc_trace_id <<- wire[2]
+  }
+  if(startsWith(request[[1]], "*")){
+    # the vectorized entry point, each argument is one call
+    mid <- substring(request[[1]], 2)
+    f <- eval(parse(text=paste0("m", mid)))
+    replies <- do.call(c, lapply(request[c(-1, -2)], function(x){
+      tryCatch(list("0", .morloc_cached(mid, list(x), f)), error=function(e) list("1", conditionMessage(e)))
+    }))
+    con <- rawConnection(raw(0), "wb")
+    .morloc_write_strings(replies, con)
+    reply <- rawConnectionValue(con)
+    close(con)
+    reply
+  } else {
+    f <- eval(parse(text=paste0("m", request[[1]])))
+    .morloc_to_raw(.morloc_cached(request[[1]], request[c(-1, -2)], f))
+  }
+}
+
+# Answer one request on a daemon connection, the caller must send the token
+# first
+.morloc_daemon_serve <- function(con, token){
+  on.exit(close(con))
+  sent <- tryCatch(.morloc_read_exact(con, nchar(token)), error=function(e) raw(0))
+  if(! identical(sent, charToRaw(token))){
+    return(invisible(NULL))
+  }
+  reply <- tryCatch(
+    list("0", .morloc_serve(.morloc_read_strings(con))),
+    error=function(e) list("1", conditionMessage(e))
+  )
+  .morloc_write_strings(reply, con)
+}
+
+# The server loop of a pool daemon. R has no Unix socket server, so the daemon
+# listens on a TCP port, which needs R 4.0 or later, and writes the port and a
+# random token to `path.port`. Each request is handled in a forked child, so
+# the daemon may be re-entered by the calls it makes to other pools. It serves
+# until the port file is removed, which the nexus does on exit, or taken over
+# by another daemon of this pool.
+.morloc_daemon <- function(path){
+  portfile <- paste0(path, ".port")
+  # another daemon may already be serving this pool
+  con <- .morloc_daemon_connect(path)
+  if(! is.null(con)){
+    close(con)
+    return(invisible(NULL))
+  }
+  server <- NULL
+  if(exists("serverSocket")){
+    # try free ports at random, a port taken by another process fails to bind
+    for(i in 1:100){
+      port <- sample(49152:65535, 1)
+      server <- tryCatch(suppressWarnings(serverSocket(port)), error=function(e) NULL)
+      if(! is.null(server)){
+        break
+      }
+    }
+  }
+  if(is.null(server)){
+    # tell callers to start this pool for each request
+    file.create(paste0(path, ".nodaemon"))
+    return(invisible(NULL))
+  }
+  token <- paste(readBin("/dev/urandom", "raw", n=16), collapse="")
+  line <- paste(port, token)
+  writeLines(as.character(Sys.getpid()), paste0(path, ".pid"))
+  # written to a private file and moved into place, so callers never read a
+  # partial port file
+  writeLines(line, paste0(portfile, ".tmp"))
+  file.rename(paste0(portfile, ".tmp"), portfile)
+  current <- function(){
+    tryCatch(suppressWarnings(readLines(portfile, n=1, warn=FALSE)), error=function(e) "")
+  }
+  while(identical(current(), line)){
+    if(! socketSelect(list(server), timeout=1)){
+      next
+    }
+    con <- socketAccept(server, blocking=TRUE, open="r+b", timeout=.morloc_socket_timeout)
+    parallel::mcparallel(.morloc_daemon_serve(con, token), detached=TRUE)
+    close(con)
+  }
+  close(server)
 }
 
 #{vsep manifolds}
@@ -368,15 +947,28 @@ makePool sources manifolds = [idoc|#!/usr/bin/env Rscript
 args <- as.list(commandArgs(trailingOnly=TRUE))
 if(length(args) == 0){
   stop("Expected 1 or more arguments")
+} else if(args[[1]] == "--daemon"){
+  .morloc_daemon(args[[2]])
+} else if(args[[1]] == "--stdin"){
+  con <- file("stdin", "rb")
+  request <- .morloc_read_strings(con)
+  close(con)
+  # stdout is a text connection, the reply may hold binary data
+  out <- pipe("cat", "wb")
+  writeBin(.morloc_serve(request), out)
+  close(out)
 } else {
   cmdID <- args[[1]]
   f_str <- paste0("m", cmdID)
   if(exists(f_str)){
     f <- eval(parse(text=paste0("m", cmdID)))
-    result <- do.call(f, args[-1])
+    result <- .morloc_cached(cmdID, args[-1], f)
     cat(result, "\n")
   } else {
     cat("Could not find manifold '", cmdID, "'\n", file=stderr())
   }
 }
-|]
+|] where
+  wireName = case wire of
+    JsonWire -> "json" :: MDoc
+    BinaryWire -> "binary"
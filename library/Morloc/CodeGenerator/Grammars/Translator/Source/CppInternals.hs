@@ -9,107 +9,1182 @@ Maintainer  : zbwrnz@gmail.com
 Stability   : experimental
 
 The @serializationHandling@ code is copy-and-pasted from
-@morloc-project/cppmorlocinternals/serial.hpp@. This is dreadful, I know, and I
-will find an alternative solution soon.
+@morloc-project/cppmorlocinternals/serial.hpp@. The @poolRuntime@ code holds
+foreign calls, the result cache and the daemon loop of a pool. Both are
+installed as headers under the morloc home directory when a pool is built,
+and their non-template functions are compiled once into a runtime library that
+pools link against (see "Morloc.ProgramBuilder.Build"). The pool runtime reads
+constants and calls functions that each pool defines, these are declared
+@extern@ in its header.
 
 -}
 
 
 
 module Morloc.CodeGenerator.Grammars.Translator.Source.CppInternals
-  ( foreignCallFunction
-  , serializationHandling
+  ( serializationHandling
+  , poolRuntime
+  , runtimeHeader
+  , poolHeader
+  , runtimeHeaders
   ) where
 
 import Morloc.Quasi
+import Morloc.Namespace (MDoc)
+import qualified Data.Text as T
 
+-- | Where @serializationHandling@ is installed, relative to an include directory
+runtimeHeader :: T.Text
+runtimeHeader = "morloc/serial.hpp"
+
+-- | Where @poolRuntime@ is installed, relative to an include directory
+poolHeader :: T.Text
+poolHeader = "morloc/pool.hpp"
+
+-- | Every runtime header with its code. A header may include those before it.
+runtimeHeaders :: [(T.Text, MDoc)]
+runtimeHeaders = [(runtimeHeader, serializationHandling), (poolHeader, poolRuntime)]
+
+poolRuntime = [idoc|#ifndef MORLOC_POOL_HPP
+#define MORLOC_POOL_HPP
+
+#include "serial.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <dirent.h>
+#include <utime.h>
+#include <errno.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <queue>
+
+extern char **environ;
+
+// Defined by each pool. _morloc_wire is the encoding of data passed to other
+// pools and _morloc_reply the encoding of the value returned to the caller.
+extern const morloc_wire_t _morloc_wire;
+extern morloc_wire_t _morloc_reply;
+extern const size_t _morloc_threads;
+extern const char* _morloc_cache_dir;
+extern const uint64_t _morloc_cache_limit;
+extern const char* _morloc_program_id;
+const char* _morloc_profile_label(int cmdID);
+std::string morloc_dispatch(int cmdID, const std::vector<std::string> &args);
+
+std::string foreign_call(const std::vector<std::string> &cmd, const std::vector<std::string> &args);
+std::vector<std::string> foreign_map(const std::vector<std::string> &cmd, const std::vector<std::string> &xs);
+std::future<std::string> _morloc_async(const std::function<std::string()> &job);
+std::string _morloc_cached(int cmdID, const std::vector<std::string> &args, std::string (*f)(int, const std::vector<std::string>&));
+int pool_stdin();
+int pool_daemon(const std::string &path);
+
+#{traceHandling}
+
+#{foreignFunctionClass}
+
+#ifdef MORLOC_RUNTIME_IMPLEMENTATION
+
+#{foreignCallFunction}
+
+#{traceFunction}
+
+#{resultCacheFunction}
+
+#{poolDaemonFunction}
+
+#endif
+#endif
+|]
+
+-- | Tracing of manifolds, serialization and foreign calls. The templates and
+-- the scope guard are used by the manifolds.
+traceHandling = [idoc|
+// When MORLOC_TRACE names a file, every manifold, serialization and foreign
+// call appends a Chrome trace event to it. The pool that a request from the
+// nexus reaches starts a trace: it creates the file with the opening bracket
+// of the event array if it does not exist yet, and names the trace. The name
+// is passed on with every foreign call, after the reply wire format and a
+// colon, so the events of all pools that served one command share it.
+extern const bool _morloc_tracing;
+extern std::string _morloc_trace_id;
+long long _morloc_trace_now();
+void _morloc_trace_event(const std::string &name, const char* cat, long long start, const std::string &args);
+
+// Records the time from its construction to the end of its scope
+class _morloc_span {
+  public:
+    _morloc_span(const char* name) : name(name), start(_morloc_tracing ? _morloc_trace_now() : 0) {}
+
+    ~_morloc_span(){
+        if(_morloc_tracing){
+            _morloc_trace_event(name, "manifold", start, "");
+        }
+    }
+
+  private:
+    const char* name;
+    long long start;
+};
+
+template <class A>
+std::string _morloc_serialize(const A &x, const A &schema, morloc_wire_t wire){
+    if(! _morloc_tracing){
+        return serialize(x, schema, wire);
+    }
+    long long start = _morloc_trace_now();
+    std::string data = serialize(x, schema, wire);
+    _morloc_trace_event("serialize", "serial", start, "\"bytes\":" + std::to_string(data.size()));
+    return data;
+}
+
+template <class A>
+A _morloc_deserialize(const std::string &data, const A &schema){
+    if(! _morloc_tracing){
+        return deserialize(data, schema);
+    }
+    long long start = _morloc_trace_now();
+    A x = deserialize(data, schema);
+    _morloc_trace_event("deserialize", "serial", start, "\"bytes\":" + std::to_string(data.size()));
+    return x;
+}
+|]
+
+traceFunction = [idoc|
+const bool _morloc_tracing = getenv("MORLOC_TRACE") != NULL;
+
+std::string _morloc_trace_id;
+
+// Microseconds of the wall clock, which all pools share
+long long _morloc_trace_now(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+}
+
+// Threads are numbered in the order they first record an event
+int _morloc_trace_thread(){
+    static std::atomic<int> threads(0);
+    thread_local int id = threads++;
+    return id;
+}
+
+// Start a trace for a request that came without one. No other pool serves
+// this request yet, so creating the file cannot race with their events.
+void _morloc_trace_root(){
+    _morloc_trace_id = std::to_string(getpid()) + "-" + std::to_string(_morloc_trace_now());
+    int fd = open(getenv("MORLOC_TRACE"), O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if(fd >= 0){
+        _fd_write(fd, "[\n");
+        close(fd);
+    }
+}
+
+// Append a complete event that started at `start`. `args` holds extra JSON
+// fields of the event arguments.
+void _morloc_trace_event(const std::string &name, const char* cat, long long start, const std::string &args){
+    long long stop = _morloc_trace_now();
+    std::string event = "{\"name\":" + serialize(name, name)
+        + ",\"cat\":\"" + cat + "\",\"ph\":\"X\""
+        + ",\"ts\":" + std::to_string(start)
+        + ",\"dur\":" + std::to_string(stop - start)
+        + ",\"pid\":" + std::to_string(getpid())
+        + ",\"tid\":" + std::to_string(_morloc_trace_thread())
+        + ",\"args\":{\"trace\":" + serialize(_morloc_trace_id, _morloc_trace_id)
+        + (args.empty() ? "" : ",") + args + "}},\n";
+    // one write of an appended line, so events of concurrent pools do not mix
+    int fd = open(getenv("MORLOC_TRACE"), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd >= 0){
+        _fd_write(fd, event);
+        close(fd);
+    }
+}
+|]
+
+-- | Foreign calls to other pools. This code expects the constants
+-- @_morloc_wire@ and @_morloc_threads@.
 foreignCallFunction = [idoc|
+// Foreign calls never go through a shell. The callee is spawned directly and
+// the request is written to its stdin as a list of strings: a 4-byte
+// little-endian count followed by length-prefixed strings. A request holds
+// the manifold id, the wire format of the reply, and the arguments. The
+// callee writes the result to stdout.
+//
+// Pools may also run as daemons that serve the same requests over a Unix
+// socket. The nexus turns this on by exporting MORLOC_SOCKET_DIR, the
+// directory where the sockets live. A socket is named after its pool file. A
+// daemon reply is a list holding a status ("0" for success, "1" for an error
+// message) and the result.
+//
+// R cannot use Unix sockets, so daemons also listen on a TCP port of the
+// loopback interface. The port and a random token are written to the file
+// `<socket>.port`. A caller sends the token before its request, so only a
+// process that can read the socket directory is served. An R daemon has only
+// the port.
+//
+// A batch request runs a single-argument manifold on many values. Its
+// manifold id is prefixed with '*' and each argument is one value. The result
+// is a packed list holding a status and a result for every value.
+
+bool _fd_write(int fd, const std::string &data){
+    size_t i = 0;
+    while(i < data.size()){
+        ssize_t n = write(fd, data.data() + i, data.size() - i);
+        if(n <= 0){
+            return false;
+        }
+        i += n;
+    }
+    return true;
+}
+
+bool _fd_read(int fd, size_t n, std::string &data){
+    data.resize(n);
+    size_t i = 0;
+    while(i < n){
+        ssize_t k = read(fd, &data[i], n - i);
+        if(k <= 0){
+            return false;
+        }
+        i += k;
+    }
+    return true;
+}
+
+std::string _pack_strings(const std::vector<std::string> &xs){
+    std::string msg;
+    _binary_write(xs.size(), 4, msg);
+    for(size_t i = 0; i < xs.size(); i++){
+        _binary_write(xs[i].size(), 4, msg);
+        msg += xs[i];
+    }
+    return msg;
+}
+
+bool _unpack_strings(const std::string &msg, std::vector<std::string> &xs){
+    size_t i = 0;
+    uint64_t n;
+    if(! _binary_read(msg, i, 4, n)){
+        return false;
+    }
+    xs.resize(n);
+    for(uint64_t k = 0; k < n; k++){
+        uint64_t m;
+        if(! _binary_read(msg, i, 4, m) || i + m > msg.size()){
+            return false;
+        }
+        xs[k] = msg.substr(i, m);
+        i += m;
+    }
+    return true;
+}
+
+bool _send_strings(int fd, const std::vector<std::string> &xs){
+    return _fd_write(fd, _pack_strings(xs));
+}
+
+bool _recv_strings(int fd, std::vector<std::string> &xs){
+    std::string header;
+    uint64_t n;
+    size_t i = 0;
+    if(! _fd_read(fd, 4, header) || ! _binary_read(header, i, 4, n)){
+        return false;
+    }
+    xs.resize(n);
+    for(uint64_t k = 0; k < n; k++){
+        uint64_t m;
+        i = 0;
+        if(! _fd_read(fd, 4, header) || ! _binary_read(header, i, 4, m) || ! _fd_read(fd, m, xs[k])){
+            return false;
+        }
+    }
+    return true;
+}
+
+// The length of the token a caller sends to a daemon's TCP port
+const size_t _daemon_token_size = 32;
+
+// Connect to the daemon at `path`, through its Unix socket or else through
+// its TCP port
+int _daemon_connect(const std::string &path){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if(connect(fd, (struct sockaddr*)&addr, sizeof addr) == 0){
+        return fd;
+    }
+    close(fd);
+
+    FILE* portfile = fopen((path + ".port").c_str(), "r");
+    if(portfile == NULL){
+        return -1;
+    }
+    int port;
+    char token[_daemon_token_size + 1];
+    bool found = fscanf(portfile, "%d %32s", &port, token) == 2;
+    fclose(portfile);
+    if(! found){
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in inet;
+    memset(&inet, 0, sizeof inet);
+    inet.sin_family = AF_INET;
+    inet.sin_port = htons(port);
+    inet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(connect(fd, (struct sockaddr*)&inet, sizeof inet) != 0 || ! _fd_write(fd, token)){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool _file_exists(const std::string &path){
+    return access(path.c_str(), F_OK) == 0;
+}
+
+// The argument vector that starts a pool in the given mode. `cmd` is the
+// pool call, its last word is the manifold id and is dropped.
+std::vector<char*> _pool_argv(const std::vector<std::string> &cmd, const char* mode){
+    std::vector<char*> argv;
+    for(size_t i = 0; i + 1 < cmd.size(); i++){
+        argv.push_back(const_cast<char*>(cmd[i].c_str()));
+    }
+    argv.push_back(const_cast<char*>(mode));
+    argv.push_back(NULL);
+    return argv;
+}
+
+// Spawn a pool, write the request to its stdin and read its stdout
+std::string _spawn_call(const std::vector<std::string> &cmd, const std::vector<std::string> &request){
+    int input[2];
+    int output[2];
+    if(pipe(input) != 0 || pipe(output) != 0){
+        throw std::runtime_error("Failed to open pipes for a foreign call");
+    }
+    // pools spawned from other threads must not inherit these pipes
+    for(int k = 0; k < 2; k++){
+        fcntl(input[k], F_SETFD, FD_CLOEXEC);
+        fcntl(output[k], F_SETFD, FD_CLOEXEC);
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, input[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, output[1], 1);
+    posix_spawn_file_actions_addclose(&actions, input[0]);
+    posix_spawn_file_actions_addclose(&actions, input[1]);
+    posix_spawn_file_actions_addclose(&actions, output[0]);
+    posix_spawn_file_actions_addclose(&actions, output[1]);
+    std::vector<char*> argv = _pool_argv(cmd, "--stdin");
+    pid_t pid;
+    int failed = posix_spawnp(&pid, argv[0], &actions, NULL, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(input[0]);
+    close(output[1]);
+    if(failed){
+        close(input[1]);
+        close(output[0]);
+        throw std::runtime_error("Failed to start pool '" + cmd[0] + "'");
+    }
+
+    // the callee reads the whole request before it writes anything
+    _send_strings(input[1], request);
+    close(input[1]);
+
+    std::string result;
+    std::vector<char> buffer(1 << 16);
+    ssize_t n;
+    while((n = read(output[0], buffer.data(), buffer.size())) > 0){
+        result.append(buffer.data(), n);
+    }
+    close(output[0]);
+
+    int status = 0;
+    pid_t waited;
+    do {
+        waited = waitpid(pid, &status, 0);
+    } while(waited < 0 && errno == EINTR);
+    if(waited != pid){
+        throw std::runtime_error("Failed to wait for pool '" + cmd[cmd.size() - 2] + "': " + strerror(errno));
+    }
+    if(! WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        throw std::runtime_error("Foreign call to pool '" + cmd[cmd.size() - 2] + "' failed");
+    }
+    return result;
+}
+
+// Connect to the daemon serving a pool, starting it if it is not running.
+// Returns -1 if the pool cannot run as a daemon.
+int _daemon_open(const std::string &path, const std::vector<std::string> &cmd){
+    int fd = _daemon_connect(path);
+    if(fd >= 0 || _file_exists(path + ".nodaemon")){
+        return fd;
+    }
+    // the daemon must not hold the caller's stdout open
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attr, 0);
+    std::vector<char*> argv = _pool_argv(cmd, "--daemon");
+    argv.insert(argv.end() - 1, const_cast<char*>(path.c_str()));
+    pid_t pid;
+    int failed = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if(failed){
+        return -1;
+    }
+    // wait for the daemon to listen, giving up if it exits first
+    for(int tries = 0; tries < 3000; tries++){
+        fd = _daemon_connect(path);
+        if(fd >= 0 || _file_exists(path + ".nodaemon") || waitpid(pid, NULL, WNOHANG) == pid){
+            break;
+        }
+        usleep(10000);
+    }
+    return fd;
+}
+
+// Send a request to the pool started by `cmd`, through its daemon if pools
+// run as daemons
+std::string _send_request(const std::vector<std::string> &cmd, const std::vector<std::string> &request){
+    const char* socket_dir = getenv("MORLOC_SOCKET_DIR");
+    if(socket_dir != NULL){
+        std::string pool = cmd[cmd.size() - 2];
+        std::string path = std::string(socket_dir) + "/" + pool.substr(pool.rfind('/') + 1);
+        int fd = _daemon_open(path, cmd);
+        if(fd >= 0){
+            std::vector<std::string> reply;
+            bool ok = _send_strings(fd, request) && _recv_strings(fd, reply) && reply.size() == 2;
+            close(fd);
+            if(! ok){
+                throw std::runtime_error("Lost connection to the pool daemon at " + path);
+            }
+            if(reply[0] != "0"){
+                throw std::runtime_error(reply[1]);
+            }
+            return reply[1];
+        }
+    }
+
+    return _spawn_call(cmd, request);
+}
+
 // Handle foreign calls. This function is used inside of C++ manifolds. Any
-// changes in the name will require a mirrored change in the morloc code. 
-std::string foreign_call(std::string cmd){
-    char buffer[256];
-    std::string result = "";
-    FILE* pipe = popen(cmd.c_str(), "r");
-    while (fgets(buffer, sizeof buffer, pipe) != NULL) {
-        result += buffer;
+// changes in the name will require a mirrored change in the morloc code. The
+// last word of `cmd` is the manifold id. The callee is asked to reply in this
+// pool's wire format.
+std::string foreign_call(const std::vector<std::string> &cmd, const std::vector<std::string> &args){
+    std::vector<std::string> request;
+    request.push_back(cmd.back());
+    request.push_back(_morloc_wire == MORLOC_WIRE_BINARY ? "binary" : "json");
+    request.insert(request.end(), args.begin(), args.end());
+    if(! _morloc_tracing){
+        return _send_request(cmd, request);
     }
-    pclose(pipe);
-    return(result);
+
+    request[1] += ":" + _morloc_trace_id;
+    long long start = _morloc_trace_now();
+    std::string result = _send_request(cmd, request);
+    size_t sent = 0;
+    for(size_t i = 0; i < args.size(); i++){
+        sent += args[i].size();
+    }
+    std::string pool = cmd[cmd.size() - 2];
+    _morloc_trace_event("foreign_call", "foreign", start,
+        "\"pool\":" + serialize(pool, pool) + ",\"manifold\":" + serialize(cmd.back(), cmd.back())
+        + ",\"sent\":" + std::to_string(sent) + ",\"received\":" + std::to_string(result.size()));
+    return result;
+}
+
+// Runs jobs on at most `_morloc_threads` worker threads. Workers are started
+// as jobs arrive, so a manifold with a single foreign call starts one thread.
+class _morloc_thread_pool {
+  public:
+    _morloc_thread_pool(size_t size) : size(size), idle(0), stopping(false) {}
+
+    ~_morloc_thread_pool(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for(size_t i = 0; i < workers.size(); i++){
+            workers[i].join();
+        }
+    }
+
+    std::future<std::string> run(const std::function<std::string()> &job){
+        std::shared_ptr<std::packaged_task<std::string()>> task(new std::packaged_task<std::string()>(job));
+        std::future<std::string> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task](){ (*task)(); });
+            if(idle == 0 && workers.size() < size){
+                workers.push_back(std::thread(&_morloc_thread_pool::work, this));
+            }
+        }
+        ready.notify_one();
+        return result;
+    }
+
+  private:
+    void work(){
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                idle++;
+                ready.wait(lock, [this](){ return stopping || ! jobs.empty(); });
+                idle--;
+                if(jobs.empty()){
+                    return;
+                }
+                job = jobs.front();
+                jobs.pop();
+            }
+            job();
+        }
+    }
+
+    size_t size;
+    size_t idle;
+    bool stopping;
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable ready;
+};
+
+// Start a foreign call that runs while the manifold goes on
+std::future<std::string> _morloc_async(const std::function<std::string()> &job){
+    static _morloc_thread_pool pool(_morloc_threads);
+    return pool.run(job);
+}
+
+// Run a single-argument manifold of another pool on every value in one call.
+// Returns a status ("0" or "1") and a result for each value.
+std::vector<std::string> foreign_map(const std::vector<std::string> &cmd, const std::vector<std::string> &xs){
+    std::vector<std::string> batch(cmd);
+    batch.back() = "*" + batch.back();
+    std::vector<std::string> replies;
+    if(! _unpack_strings(foreign_call(batch, xs), replies) || replies.size() != 2 * xs.size()){
+        throw std::runtime_error("Malformed batch reply from pool '" + cmd[cmd.size() - 2] + "'");
+    }
+    return replies;
+}
+|]
+
+-- | Functions of other pools passed as values to manifolds. These are
+-- templates, so they are part of the header rather than the runtime library.
+foreignFunctionClass = [idoc|
+// Collects every value of type A nested in lists and tuples
+template <class A>
+struct _morloc_collector {
+    std::vector<A> &found;
+    _morloc_collector(std::vector<A> &found) : found(found) {}
+
+    void operator()(const A &x){
+        found.push_back(x);
+    }
+
+    template <class T>
+    void operator()(const T &){}
+
+    template <class T>
+    void operator()(const std::vector<T> &xs){
+        for(size_t i = 0; i < xs.size(); i++){
+            (*this)(xs[i]);
+        }
+    }
+
+    template <std::size_t I, class... T>
+    typename std::enable_if<I == sizeof...(T), void>::type
+    collect_tuple(const std::tuple<T...> &){}
+
+    template <std::size_t I, class... T>
+    typename std::enable_if<I < sizeof...(T), void>::type
+    collect_tuple(const std::tuple<T...> &x){
+        (*this)(std::get<I>(x));
+        collect_tuple<I + 1>(x);
+    }
+
+    template <class... T>
+    void operator()(const std::tuple<T...> &x){
+        collect_tuple<0>(x);
+    }
+};
+
+// A function from another pool passed as a value. Each call is a foreign
+// call, unless the argument was seen by `prefetch`, which evaluates every
+// value of the argument type found in a container with one batched call. The
+// code generator prefetches over the other arguments of the function this
+// value is passed to, so a function mapped over a list launches the foreign
+// pool once rather than once per element.
+template <class B, class... A>
+class _foreign_function {
+  public:
+    _foreign_function(const std::vector<std::string> &cmd)
+      : cmd(cmd), cache(new std::map<std::string, std::string>) {}
+
+    B operator()(const A&... xs) const {
+        std::vector<std::string> args = { _morloc_serialize(xs, A(), _morloc_wire)... };
+        B schema = B();
+        if(args.size() == 1){
+            std::map<std::string, std::string>::const_iterator hit = cache->find(args[0]);
+            if(hit != cache->end()){
+                return _morloc_deserialize(hit->second, schema);
+            }
+        }
+        return _morloc_deserialize(foreign_call(cmd, args), schema);
+    }
+
+    template <class T>
+    void prefetch(const T &x) const {
+        std::vector<typename std::tuple_element<0, std::tuple<A...>>::type> found;
+        _morloc_collector<typename std::tuple_element<0, std::tuple<A...>>::type> collect(found);
+        collect(x);
+        std::vector<std::string> keys;
+        for(size_t i = 0; i < found.size(); i++){
+            std::string key = serialize(found[i], found[i], _morloc_wire);
+            if(cache->find(key) == cache->end()){
+                (*cache)[key] = "";
+                keys.push_back(key);
+            }
+        }
+        if(keys.size() < 2){
+            for(size_t i = 0; i < keys.size(); i++){
+                cache->erase(keys[i]);
+            }
+            return;
+        }
+        std::vector<std::string> replies;
+        try {
+            replies = foreign_map(cmd, keys);
+        } catch (const std::exception &e) {
+            // values that fail are called one at a time
+        }
+        for(size_t i = 0; i < keys.size(); i++){
+            if(replies.size() == 2 * keys.size() && replies[2 * i] == "0"){
+                (*cache)[keys[i]] = replies[2 * i + 1];
+            } else {
+                cache->erase(keys[i]);
+            }
+        }
+    }
+
+  private:
+    std::vector<std::string> cmd;
+    // shared, since source functions usually take their function arguments
+    // by value, and behind a pointer, since a const function still caches
+    std::shared_ptr<std::map<std::string, std::string>> cache;
+};
+
+template <class F, class T>
+void _morloc_prefetch(const F &, const T &){}
+
+template <class B, class A, class T>
+void _morloc_prefetch(const _foreign_function<B, A> &f, const T &x){
+    f.prefetch(x);
+}
+|]
+
+-- | The on-disk cache of pool results. This code expects the constants
+-- @_morloc_cache_dir@, @_morloc_cache_limit@ and @_morloc_program_id@.
+resultCacheFunction = [idoc|
+// Results of manifolds called by the nexus or by another pool may be cached on
+// disk. The key of an entry is the identity of the program build, the manifold
+// id, the reply wire format and the serialized arguments. An entry file is
+// named after a hash of the key and holds the key fields followed by the
+// result, so a hash collision is never taken for a hit. Once the cache grows
+// past its limit, the least recently used entries are removed.
+
+std::string _cache_hash(const std::string &x){
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < x.size(); i++){
+        h ^= (unsigned char)x[i];
+        h *= 1099511628211ULL;
+    }
+    char hex[17];
+    snprintf(hex, sizeof hex, "%016llx", (unsigned long long)h);
+    return std::string(hex);
+}
+
+bool _read_file(const std::string &path, std::string &data){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && _fd_read(fd, st.st_size, data);
+    close(fd);
+    return ok;
+}
+
+void _make_dirs(const std::string &path){
+    for(size_t i = 1; i <= path.size(); i++){
+        if(i == path.size() || path[i] == '/'){
+            mkdir(path.substr(0, i).c_str(), 0755);
+        }
+    }
+}
+
+struct _cache_entry {
+    double used;
+    off_t size;
+    std::string path;
+    bool operator<(const _cache_entry &other) const {
+        return used < other.used;
+    }
+};
+
+void _cache_evict(const std::string &dir, uint64_t limit){
+    std::vector<_cache_entry> entries;
+    uint64_t total = 0;
+    DIR* handle = opendir(dir.c_str());
+    if(handle == NULL){
+        return;
+    }
+    struct dirent* file;
+    while((file = readdir(handle)) != NULL){
+        std::string name = file->d_name;
+        struct stat st;
+        _cache_entry entry;
+        entry.path = dir + "/" + name;
+        // skip ".", ".." and entries that are still being written
+        if(name[0] == '.' || name.find(".tmp") != std::string::npos || stat(entry.path.c_str(), &st) != 0){
+            continue;
+        }
+#ifdef __APPLE__
+        entry.used = st.st_mtimespec.tv_sec + 1e-9 * st.st_mtimespec.tv_nsec;
+#else
+        entry.used = st.st_mtim.tv_sec + 1e-9 * st.st_mtim.tv_nsec;
+#endif
+        entry.size = st.st_size;
+        total += st.st_size;
+        entries.push_back(entry);
+    }
+    closedir(handle);
+    std::sort(entries.begin(), entries.end());
+    for(size_t i = 0; i < entries.size() && total > limit; i++){
+        unlink(entries[i].path.c_str());
+        total -= entries[i].size;
+    }
+}
+
+// When MORLOC_PROFILE names a file, every run of a labeled manifold appends
+// a line to it: the pool language, the label, the size of the arguments in
+// bytes and the wall time in nanoseconds. `morloc make --profile` reads these.
+std::string _morloc_profiled(int cmdID, const std::vector<std::string> &args, std::string (*f)(int, const std::vector<std::string>&)){
+    const char* profile = getenv("MORLOC_PROFILE");
+    const char* label = _morloc_profile_label(cmdID);
+    if(profile == NULL || label[0] == '\0'){
+        return f(cmdID, args);
+    }
+    size_t bytes = 0;
+    for(size_t i = 0; i < args.size(); i++){
+        bytes += args[i].size();
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string result = f(cmdID, args);
+    auto stop = std::chrono::steady_clock::now();
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+    // one write of an appended line, so lines of concurrent pools do not mix
+    std::string line = std::string("Cpp\t") + label + "\t" + std::to_string(bytes) + "\t" + std::to_string(ns) + "\n";
+    int fd = open(profile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd >= 0){
+        _fd_write(fd, line);
+        close(fd);
+    }
+    return result;
+}
+
+std::string _morloc_cached(int cmdID, const std::vector<std::string> &args, std::string (*f)(int, const std::vector<std::string>&)){
+    if(_morloc_tracing && _morloc_trace_id.empty()){
+        _morloc_trace_root();
+    }
+    if(_morloc_cache_limit == 0){
+        return _morloc_profiled(cmdID, args, f);
+    }
+
+    std::vector<std::string> key;
+    key.push_back(_morloc_program_id);
+    key.push_back(std::to_string(cmdID));
+    key.push_back(_morloc_reply == MORLOC_WIRE_BINARY ? "binary" : "json");
+    key.insert(key.end(), args.begin(), args.end());
+    std::string path = std::string(_morloc_cache_dir) + "/" + _cache_hash(_pack_strings(key));
+
+    std::string data;
+    std::vector<std::string> entry;
+    if(_read_file(path, data) && _unpack_strings(data, entry) && entry.size() == key.size() + 1
+       && std::equal(key.begin(), key.end(), entry.begin())){
+        utime(path.c_str(), NULL); // mark the entry as recently used
+        return entry.back();
+    }
+
+    std::string result = _morloc_profiled(cmdID, args, f);
+
+    // write the entry to a private file and move it into place, so readers
+    // never see a partial entry
+    key.push_back(result);
+    _make_dirs(_morloc_cache_dir);
+    std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0){
+        bool written = _fd_write(fd, _pack_strings(key));
+        close(fd);
+        if(! written || rename(tmp.c_str(), path.c_str()) != 0){
+            unlink(tmp.c_str());
+        }
+        _cache_evict(_morloc_cache_dir, _morloc_cache_limit);
+    }
+    return result;
 }
 |]
 
-serializationHandling = [idoc|
+-- | The server loop of a pool daemon. Each request is handled in a forked
+-- child, so a daemon may be re-entered by the calls it makes to other pools.
+-- This code expects a @morloc_dispatch@ function that calls a manifold by id.
+poolDaemonFunction = [idoc|
+// Run a request read from a caller: the manifold id, the reply wire format and
+// the arguments
+std::string _serve_request(const std::vector<std::string> &request){
+    if(request.size() < 2){
+        throw std::runtime_error("Malformed pool request");
+    }
+    // a traced caller appends the trace id to the wire format
+    std::string wire = request[1];
+    size_t colon = wire.find(':');
+    if(colon != std::string::npos){
+        _morloc_trace_id = wire.substr(colon + 1);
+        wire = wire.substr(0, colon);
+    }
+    _morloc_reply = wire == "binary" ? MORLOC_WIRE_BINARY : MORLOC_WIRE_JSON;
+    if(request[0][0] == '*'){
+        // the vectorized entry point, each argument is one call
+        int cmdID = std::stoi(request[0].substr(1));
+        std::vector<std::string> replies;
+        for(size_t i = 2; i < request.size(); i++){
+            try {
+                std::string result = _morloc_cached(cmdID, std::vector<std::string>(1, request[i]), morloc_dispatch);
+                replies.push_back("0");
+                replies.push_back(result);
+            } catch (const std::exception &e) {
+                replies.push_back("1");
+                replies.push_back(e.what());
+            }
+        }
+        return _pack_strings(replies);
+    }
+    std::vector<std::string> args(request.begin() + 2, request.end());
+    return _morloc_cached(std::stoi(request[0]), args, morloc_dispatch);
+}
+
+// Answer one request written to stdin, the caller reads the result from stdout
+int pool_stdin(){
+    std::vector<std::string> request;
+    if(! _recv_strings(0, request)){
+        std::cerr << "Failed to read a pool request from stdin" << std::endl;
+        return 1;
+    }
+    try {
+        return _fd_write(1, _serve_request(request)) ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
+
+void _daemon_serve(int fd){
+    std::vector<std::string> request;
+    std::vector<std::string> reply(2);
+    if(! _recv_strings(fd, request)){
+        return;
+    }
+    try {
+        reply[1] = _serve_request(request);
+        reply[0] = "0";
+    } catch (const std::exception &e) {
+        reply[0] = "1";
+        reply[1] = e.what();
+    }
+    _send_strings(fd, reply);
+}
+
+// Defined only in pools instrumented for a profile-guided build, which are
+// linked with `-u __gcov_dump` since a weak reference does not pull it from
+// libgcov. A request child leaves with _exit, which skips writing the
+// profile, so it is written explicitly.
+extern "C" void __gcov_dump(void) __attribute__((weak));
+
+// Listen on a free TCP port of the loopback interface and write the port and
+// a random token to `<path>.port`. Returns the listening socket, or -1 if
+// the daemon is reachable only through its Unix socket.
+int _daemon_listen_port(const std::string &path, std::string &token){
+    unsigned char bytes[_daemon_token_size / 2];
+    FILE* random = fopen("/dev/urandom", "rb");
+    bool seeded = random != NULL && fread(bytes, 1, sizeof bytes, random) == sizeof bytes;
+    if(random != NULL){
+        fclose(random);
+    }
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0; // any free port
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof addr;
+    if(! seeded || server < 0
+               || bind(server, (struct sockaddr*)&addr, sizeof addr) != 0
+               || listen(server, 64) != 0
+               || getsockname(server, (struct sockaddr*)&addr, &size) != 0){
+        if(server >= 0){
+            close(server);
+        }
+        return -1;
+    }
+    token.clear();
+    for(size_t i = 0; i < sizeof bytes; i++){
+        token += "0123456789abcdef"[bytes[i] >> 4];
+        token += "0123456789abcdef"[bytes[i] & 15];
+    }
+    // written to a private file and moved into place, so callers never read
+    // a partial port file
+    std::string tmp = path + ".port.tmp";
+    FILE* portfile = fopen(tmp.c_str(), "w");
+    if(portfile == NULL){
+        close(server);
+        return -1;
+    }
+    fprintf(portfile, "%d %s\n", (int)ntohs(addr.sin_port), token.c_str());
+    fclose(portfile);
+    rename(tmp.c_str(), (path + ".port").c_str());
+    return server;
+}
+
+// Serve requests until the socket is removed, which the nexus does on exit
+int pool_daemon(const std::string &path){
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if(bind(server, (struct sockaddr*)&addr, sizeof addr) != 0){
+        // another daemon may already be serving this pool
+        int fd = _daemon_connect(path);
+        if(fd >= 0){
+            close(fd);
+            return 0;
+        }
+        unlink(path.c_str());
+        if(bind(server, (struct sockaddr*)&addr, sizeof addr) != 0){
+            perror("pool daemon");
+            return 1;
+        }
+    }
+    listen(server, 64);
+    FILE* pidfile = fopen((path + ".pid").c_str(), "w");
+    if(pidfile != NULL){
+        fprintf(pidfile, "%d\n", (int)getpid());
+        fclose(pidfile);
+    }
+    std::string token;
+    int inet = _daemon_listen_port(path, token);
+    // Finished request children are reaped here rather than by ignoring
+    // SIGCHLD, since an ignored SIGCHLD is inherited by the children, whose
+    // foreign calls then cannot wait for the exit status of their callees.
+    while(_file_exists(path)){
+        while(waitpid(-1, NULL, WNOHANG) > 0){ }
+        struct pollfd p[2] = {{server, POLLIN, 0}, {inet, POLLIN, 0}};
+        if(poll(p, inet >= 0 ? 2 : 1, 1000) <= 0){
+            continue;
+        }
+        // a TCP caller must send the token first
+        bool tcp = ! (p[0].revents & POLLIN);
+        int fd = accept(tcp ? inet : server, NULL, NULL);
+        if(fd < 0){
+            continue;
+        }
+        if(fork() == 0){
+            close(server);
+            if(inet >= 0){
+                close(inet);
+            }
+            std::string sent;
+            if(! tcp || (_fd_read(fd, _daemon_token_size, sent) && sent == token)){
+                _daemon_serve(fd);
+            }
+            close(fd);
+            if(__gcov_dump){
+                __gcov_dump();
+            }
+            _exit(0);
+        }
+        close(fd);
+    }
+    return 0;
+}
+|]
+
+serializationHandling = [idoc|#ifndef MORLOC_SERIAL_HPP
+#define MORLOC_SERIAL_HPP
+
+// The morloc C++ runtime. Templates and small functions that should be
+// inlined are defined here. The remaining functions are defined only where
+// MORLOC_RUNTIME_IMPLEMENTATION is defined before this header is included,
+// which is done once in the runtime library that pools link against, or in
+// a program that uses this header alone.
+
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <stdexcept>
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 #include <vector>
 #include <iomanip>
 #include <limits>
 #include <tuple>
 #include <utility> 
+#include <string.h>
+#include <stdint.h>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#if defined(__has_include) && __cplusplus >= 201703L
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
 
 
-std::string serialize(bool x, bool schema);
-std::string serialize(int x, int schema);
-std::string serialize(int x, size_t schema);
-std::string serialize(int x, long schema);
-std::string serialize(double x, double schema);
-std::string serialize(float x, float schema);
-std::string serialize(std::string x, std::string schema);
+// All serializers append to a single output buffer that is threaded through
+// every overload. The schema arguments are used only to select an overload.
+inline void serialize(bool x, bool schema, std::string &json);
+inline void serialize(int x, int schema, std::string &json);
+inline void serialize(size_t x, size_t schema, std::string &json);
+inline void serialize(long x, long schema, std::string &json);
+inline void serialize(double x, double schema, std::string &json);
+inline void serialize(float x, float schema, std::string &json);
+inline void serialize(const std::string &x, const std::string &schema, std::string &json);
+void _json_escape(unsigned char c, std::string &json);
 
-template <class A> std::string serialize(A x);
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I == sizeof...(Rs), void>::type
+  _serialize_tuple(const std::tuple<Rs...> &x, std::string &json);
 
-template<std::size_t I = 0, class... Rs>
-inline typename std::enable_if<I == sizeof...(Rs), std::string>::type
-  _serialize_tuple(std::tuple<Rs...> x);
-
-template<std::size_t I = 0, class... Rs>
-inline typename std::enable_if<I < sizeof...(Rs), std::string>::type
-  _serialize_tuple(std::tuple<Rs...> x);
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I < sizeof...(Rs), void>::type
+  _serialize_tuple(const std::tuple<Rs...> &x, std::string &json);
 
 template <class... A>
-std::string serialize(std::tuple<A...> x, std::tuple<A...> schema);
+void serialize(const std::tuple<A...> &x, const std::tuple<A...> &schema, std::string &json);
+
+template <class A>
+void serialize(const std::vector<A> &x, const std::vector<A> &schema, std::string &json);
+
+template <class A> std::string serialize(const A &x, const A &schema);
+template <class A> std::string serialize(const A &x);
+
+inline bool match(const std::string &json, const char* pattern, size_t &i);
+inline void whitespace(const std::string &json, size_t &i);
+void _write_decimal(bool negative, const char* digits, int ndigits, int exponent, std::string &json);
+bool _scan_number(const std::string &json, size_t &i, bool &negative, unsigned long long &mantissa, int &exponent, bool &exact);
+
+template <class A>
+void _serialize_real(A x, std::string &json);
 
 template <class A>
-std::string serialize(std::vector<A> x, std::vector<A> schema);
+bool _deserialize_real(const std::string &json, size_t &i, A &x);
+
+// attempt a run a parser, on failure, consume no input
+template <class A>
+bool try_parse(const std::string &json, size_t &i, A &x, bool (*f)(const std::string &, size_t &, A &));
+
+inline bool deserialize(const std::string &json, size_t &i, bool &x);
+inline bool deserialize(const std::string &json, size_t &i, double &x);
+inline bool deserialize(const std::string &json, size_t &i, float &x);
+bool deserialize(const std::string &json, size_t &i, std::string &x);
+bool _json_unescape(const std::string &json, size_t &i, std::string &x);
+
+template <class A>
+bool integer_deserialize(const std::string &json, size_t &i, A &x);
+inline bool deserialize(const std::string &json, size_t &i, int &x);
+inline bool deserialize(const std::string &json, size_t &i, size_t &x);
+inline bool deserialize(const std::string &json, size_t &i, long &x);
+
+template <class A>
+bool deserialize(const std::string &json, size_t &i, std::vector<A> &x);
+
+template <class A>
+bool _deserialize_tuple(const std::string &json, size_t &i, std::tuple<A> &x);
+
+template <class A, class... Rest>
+bool _deserialize_tuple(const std::string &json, size_t &i, std::tuple<A, Rest...> &x);
 
-bool match(const std::string json, const std::string pattern, size_t &i);
-void whitespace(const std::string json, size_t &i);
-std::string digit_str(const std::string json, size_t &i);
-double read_double(std::string json);
-float read_float(std::string json);
+template <class... Rest>
+bool deserialize(const std::string &json, size_t &i, std::tuple<Rest...> &x);
 
-// attempt a run a parser, on failure, consume no input
 template <class A>
-bool try_parse(std::string json, size_t &i, A &x, bool (*f)(std::string, size_t &, A &));
+A deserialize(const std::string &json, A output);
 
-bool deserialize(const std::string json, size_t &i, bool &x);
-bool deserialize(const std::string json, size_t &i, double &x);
-bool deserialize(const std::string json, size_t &i, float &x);
-bool deserialize(const std::string json, size_t &i, std::string &x);
+// Encodings that may be used for data passed between pools
+enum morloc_wire_t { MORLOC_WIRE_JSON, MORLOC_WIRE_BINARY };
 
-template <class A>
-bool integer_deserialize(const std::string json, size_t &i, A &x);
-bool deserialize(const std::string json, size_t &i, int &x);
-bool deserialize(const std::string json, size_t &i, size_t &x);
-bool deserialize(const std::string json, size_t &i, long &x);
+template <class A> std::string serialize(const A &x, const A &schema, morloc_wire_t wire);
 
-template <class A>
-bool deserialize(const std::string json, size_t &i, std::vector<A> &x);
+inline void binary_serialize(bool x, bool schema, std::string &buf);
+inline void binary_serialize(int x, int schema, std::string &buf);
+inline void binary_serialize(size_t x, size_t schema, std::string &buf);
+inline void binary_serialize(long x, long schema, std::string &buf);
+inline void binary_serialize(double x, double schema, std::string &buf);
+inline void binary_serialize(float x, float schema, std::string &buf);
+inline void binary_serialize(const std::string &x, const std::string &schema, std::string &buf);
 
 template <class A>
-bool _deserialize_tuple(const std::string json, size_t &i, std::tuple<A> &x);
+void binary_serialize(const std::vector<A> &x, const std::vector<A> &schema, std::string &buf);
 
-template <class A, class... Rest>
-bool _deserialize_tuple(const std::string json, size_t &i, std::tuple<A, Rest...> &x);
+template <class... A>
+void binary_serialize(const std::tuple<A...> &x, const std::tuple<A...> &schema, std::string &buf);
 
-template <class... Rest>
-bool deserialize(const std::string json, size_t &i, std::tuple<Rest...> &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, bool &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, int &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, size_t &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, long &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, double &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, float &x);
+inline bool binary_deserialize(const std::string &buf, size_t &i, std::string &x);
 
 template <class A>
-A deserialize(const std::string json, A output);
+bool binary_deserialize(const std::string &buf, size_t &i, std::vector<A> &x);
+
+template <class... Rest>
+bool binary_deserialize(const std::string &buf, size_t &i, std::tuple<Rest...> &x);
 
 
 
@@ -118,96 +1193,128 @@ A deserialize(const std::string json, A output);
 /*                       S E R I A L I Z A T I O N                        */
 /* ---------------------------------------------------------------------- */
 
-std::string serialize(bool x, bool schema){
-    return(x? "true" : "false");
+inline void serialize(bool x, bool schema, std::string &json){
+    json += x ? "true" : "false";
 }
 
-std::string serialize(int x, int schema){
-    std::ostringstream s;
-    s << x;
-    return(s.str());
+inline void serialize(int x, int schema, std::string &json){
+    json += std::to_string(x);
 }
-std::string serialize(int x, size_t schema){
-    std::ostringstream s;
-    s << x;
-    return(s.str());
+inline void serialize(size_t x, size_t schema, std::string &json){
+    json += std::to_string(x);
 }
-std::string serialize(int x, long schema){
-    std::ostringstream s;
-    s << x;
-    return(s.str());
+inline void serialize(long x, long schema, std::string &json){
+    json += std::to_string(x);
 }
 
-std::string serialize(double x, double schema){
-    std::ostringstream s;
-    s << std::setprecision(std::numeric_limits<double>::digits10 + 2) << x;
-    return(s.str());
+inline void serialize(double x, double schema, std::string &json){
+    _serialize_real(x, json);
 }
 
-std::string serialize(float x, float schema){
-    std::ostringstream s;
-    s << std::setprecision(std::numeric_limits<float>::digits10 + 2) << x;
-    return(s.str());
+inline void serialize(float x, float schema, std::string &json){
+    _serialize_real(x, json);
 }
 
-std::string serialize(std::string x, std::string schema){
-    std::ostringstream s;
-    s << '"' << x << '"';
-    return(s.str());
+// Runs of characters that need no escape are copied at once
+inline void serialize(const std::string &x, const std::string &schema, std::string &json){
+    json += '"';
+    size_t start = 0;
+    for(size_t i = 0; i < x.size(); i++){
+        unsigned char c = (unsigned char)x[i];
+        if(c < 0x20 || c == '"' || c == '\\'){
+            json.append(x, start, i - start);
+            _json_escape(c, json);
+            start = i + 1;
+        }
+    }
+    json.append(x, start, x.size() - start);
+    json += '"';
 }
 
-template <class A>
-std::string serialize(std::vector<A> x, std::vector<A> schema){
-    A element_schema;
-    std::ostringstream s;
-    s << "[";
-    for(size_t i = 0; i < x.size(); i++){
-        s << serialize(x[i], element_schema);
-        if((i+1) < x.size()){
-            s << ',';
+#ifdef MORLOC_RUNTIME_IMPLEMENTATION
+// Write the JSON escape of a quote, backslash or control character
+void _json_escape(unsigned char c, std::string &json){
+    switch(c){
+        case '"': json += "\\\""; break;
+        case '\\': json += "\\\\"; break;
+        case '\b': json += "\\b"; break;
+        case '\f': json += "\\f"; break;
+        case '\n': json += "\\n"; break;
+        case '\r': json += "\\r"; break;
+        case '\t': json += "\\t"; break;
+        default: {
+            char hex[8];
+            snprintf(hex, sizeof hex, "\\u%04x", c);
+            json += hex;
         }
     }
-    s << "]";
-    return (s.str());
 }
+#endif
 
 template <class A>
-std::string serialize(A x){
-    return serialize(x, x);
+void serialize(const std::vector<A> &x, const std::vector<A> &schema, std::string &json){
+    A element_schema{};
+    json += '[';
+    for(size_t i = 0; i < x.size(); i++){
+        if(i > 0){
+            json += ',';
+        }
+        serialize(x[i], element_schema, json);
+    }
+    json += ']';
 }
 
 // adapted from stackoverflow #1198260 answer from emsr
-template<std::size_t I = 0, class... Rs>
-inline typename std::enable_if<I == sizeof...(Rs), std::string>::type
-  _serialize_tuple(std::tuple<Rs...> x)
-  { return ""; }
-
-template<std::size_t I = 0, class... Rs>
-inline typename std::enable_if<I < sizeof...(Rs), std::string>::type
-  _serialize_tuple(std::tuple<Rs...> x)
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I == sizeof...(Rs), void>::type
+  _serialize_tuple(const std::tuple<Rs...> &x, std::string &json)
+  { }
+
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I < sizeof...(Rs), void>::type
+  _serialize_tuple(const std::tuple<Rs...> &x, std::string &json)
   {
-    return serialize(std::get<I>(x)) + "," + _serialize_tuple<I + 1, Rs...>(x);
+    if(I > 0){
+        json += ',';
+    }
+    serialize(std::get<I>(x), std::get<I>(x), json);
+    _serialize_tuple<I + 1, Rs...>(x, json);
   }
 
 template <class... A>
-std::string serialize(std::tuple<A...> x, std::tuple<A...> schema){
-    std::ostringstream ss;
-    ss << "[";
-    ss << _serialize_tuple(x);
-    std::string json = ss.str();
-    // _serialize_tuple adds a terminal comma, replaced here with the end bracket
-    json[json.size() - 1] = ']';
+void serialize(const std::tuple<A...> &x, const std::tuple<A...> &schema, std::string &json){
+    json += '[';
+    _serialize_tuple<0, A...>(x, json);
+    json += ']';
+}
+
+// The top-level serializers, these create the buffer that is passed down
+template <class A>
+std::string serialize(const A &x, const A &schema){
+    std::string json;
+    serialize(x, schema, json);
     return json;
 }
 
+template <class A>
+std::string serialize(const A &x){
+    return serialize(x, x);
+}
+
 
 /* ---------------------------------------------------------------------- */
 /*                             P A R S E R S                              */
 /* ---------------------------------------------------------------------- */
 
+// All parsers walk the same borrowed JSON buffer. It is passed by reference
+// from the top-level `deserialize` call down to the leaves, so no parser ever
+// copies the input. `json[json.size()]` is guaranteed to be '\0', so looking
+// one character past the end is safe and always fails to match.
+
 // match a constant string, nothing is consumed on failure
-bool match(const std::string json, const std::string pattern, size_t &i){
-    for(size_t j = 0; j < pattern.size(); j++){
+inline bool match(const std::string &json, const char* pattern, size_t &i){
+    size_t j = 0;
+    for(; pattern[j] != '\0'; j++){
         if(j + i >= json.size()){
             return false;
         }
@@ -215,47 +1322,302 @@ bool match(const std::string json, const std::string pattern, size_t &i){
             return false;
         }
     }
-    i += pattern.size();
+    i += j;
     return true;
 }
 
-void whitespace(const std::string json, size_t &i){
-    while(json[i] == ' ' || json[i] == '\n' || json[i] == '\t'){
+inline void whitespace(const std::string &json, size_t &i){
+    while(json[i] == ' ' || json[i] == '\n' || json[i] == '\t' || json[i] == '\r'){
         i++;
     }
 }
 
-// parse sequences of digits from a larger string
-// used as part of a larger number parser
-std::string digit_str(const std::string json, size_t &i){
-    std::string num = "";
-    while(json[i] >= '0' && json[i] <= '9'){
-        num += json[i];
-        i++;
+// attempt a run a parser, on failure, consume no input
+template <class A>
+bool try_parse(const std::string &json, size_t &i, A &x, bool (*f)(const std::string &, size_t &, A &)){
+    size_t j = i;
+    if(f(json, i, x)){
+        return true;
+    } else {
+        i = j;
+        return false;
     }
-    return num;
 }
 
-double read_double(std::string json){
-    return std::stod(json.c_str());
+/* ---------------------------------------------------------------------- */
+/*                             N U M B E R S                              */
+/* ---------------------------------------------------------------------- */
+
+// Numbers are written and read without streams, heap allocation or locale
+// dependent formatting. Most values take an exact fast path: a decimal whose
+// digits fit in the significand and whose power of ten is itself exactly
+// representable is converted with a single multiplication or division
+// (Clinger's fast path). Everything else falls back on the C library.
+
+// powers of ten that are exactly representable as doubles
+const double _exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#ifndef __cpp_lib_to_chars
+// The C locale, in which the decimal point is always '.'. It is created once
+// and never freed.
+inline locale_t _c_locale(){
+    static locale_t c = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    return c;
 }
+#endif
+
+// Read the number that spans [begin, end), whatever the process locale. The
+// text after end must not continue the number. Fails unless exactly the
+// span is read.
+template <class A> struct _real_traits;
+
+template <> struct _real_traits<double> {
+    // the largest n where 10^n is exactly representable
+    static const int max_pow10 = 22;
+    static bool read(const char* begin, const char* end, double &x){
+#ifdef __cpp_lib_to_chars
+        return std::from_chars(begin, end, x).ptr == end;
+#else
+        char* stop;
+        x = strtod_l(begin, &stop, _c_locale());
+        return stop == end;
+#endif
+    }
+};
+
+template <> struct _real_traits<float> {
+    static const int max_pow10 = 10;
+    static bool read(const char* begin, const char* end, float &x){
+#ifdef __cpp_lib_to_chars
+        return std::from_chars(begin, end, x).ptr == end;
+#else
+        char* stop;
+        x = strtof_l(begin, &stop, _c_locale());
+        return stop == end;
+#endif
+    }
+};
 
-float read_float(std::string json){
-    return std::stof(json.c_str());
+#ifdef MORLOC_RUNTIME_IMPLEMENTATION
+// Write a number given its significant digits and the decimal exponent of
+// the first digit. The layout matches Python's float repr, so numbers look
+// the same whichever pool wrote them.
+void _write_decimal(bool negative, const char* digits, int ndigits, int exponent, std::string &json){
+    if(negative){
+        json += '-';
+    }
+    if(exponent < -4 || exponent >= 16){
+        json += digits[0];
+        if(ndigits > 1){
+            json += '.';
+            json.append(digits + 1, ndigits - 1);
+        }
+        json += exponent < 0 ? "e-" : "e+";
+        int e = exponent < 0 ? -exponent : exponent;
+        if(e >= 100){
+            json += (char)('0' + e / 100);
+        }
+        json += (char)('0' + (e / 10) % 10);
+        json += (char)('0' + e % 10);
+    } else if(exponent < 0){
+        json += "0.";
+        json.append(-exponent - 1, '0');
+        json.append(digits, ndigits);
+    } else if(ndigits <= exponent + 1){
+        json.append(digits, ndigits);
+        json.append(exponent + 1 - ndigits, '0');
+    } else {
+        json.append(digits, exponent + 1);
+        json += '.';
+        json.append(digits + exponent + 1, ndigits - exponent - 1);
+    }
 }
+#endif
 
-// attempt a run a parser, on failure, consume no input
+// Write the shortest decimal that reads back as exactly `x`
 template <class A>
-bool try_parse(std::string json, size_t &i, A &x, bool (*f)(std::string, size_t &, A &)){
-    size_t j = i;
-    if(f(json, i, x)){
-        return true;
-    } else {
-        i = j;
+void _serialize_real(A x, std::string &json){
+    if(x != x){
+        json += "nan";
+        return;
+    }
+    if(x == std::numeric_limits<A>::infinity() || x == -std::numeric_limits<A>::infinity()){
+        json += x < 0 ? "-inf" : "inf";
+        return;
+    }
+
+    bool negative = signbit(x);
+    A y = negative ? -x : x;
+    char digits[32];
+    int ndigits = 0;
+    int exponent = 0;
+
+    // Fast path: find the fewest decimal places k for which some integer n
+    // near y * 10^k is read back by the parser's fast path (as n / 10^k) to
+    // exactly y. The product is rounded, so the neighbours of the nearest
+    // integer are tried as well.
+    const A max_exact = (A)(1ULL << std::numeric_limits<A>::digits);
+    for(int k = 0; k <= _real_traits<A>::max_pow10; k++){
+        A m = y * (A)_exact_pow10[k];
+        if(m + 1 >= max_exact){
+            break;
+        }
+        unsigned long long nearest = (unsigned long long)(m + (A)0.5);
+        unsigned long long candidates[3] = {nearest, nearest + 1, nearest - 1};
+        for(int c = 0; c < 3; c++){
+            unsigned long long n = candidates[c];
+            if(n > nearest + 1 || (A)n / (A)_exact_pow10[k] != y){
+                continue;
+            }
+            char reversed[32];
+            int nreversed = 0;
+            do {
+                reversed[nreversed++] = (char)('0' + n % 10);
+                n /= 10;
+            } while(n > 0);
+            for(int j = nreversed - 1; j >= 0; j--){
+                digits[ndigits++] = reversed[j];
+            }
+            exponent = nreversed - 1 - k;
+            while(ndigits > 1 && digits[ndigits - 1] == '0'){
+                ndigits--;
+            }
+            _write_decimal(negative, digits, ndigits, exponent, json);
+            return;
+        }
+    }
+
+    // General case: increase the precision until the value round-trips. Only
+    // the digits and exponent are taken from the C library output, so the
+    // locale's decimal point never reaches the JSON. Subnormals carry fewer
+    // significant digits, so their search starts from one digit.
+    char buffer[64];
+    int precision = y < std::numeric_limits<A>::min() ? 1 : std::numeric_limits<A>::digits10;
+    for(; ; precision++){
+        snprintf(buffer, sizeof buffer, "%.*e", precision - 1, (double)y);
+        // the locale's decimal point is replaced so the C locale reads it
+        for(char* q = buffer; *q != 'e'; q++){
+            if(*q != '-' && (*q < '0' || *q > '9')){
+                *q = '.';
+            }
+        }
+        A z;
+        if(precision >= std::numeric_limits<A>::max_digits10 ||
+           (_real_traits<A>::read(buffer, buffer + strlen(buffer), z) && z == y)){
+            break;
+        }
+    }
+    char* p = buffer;
+    for(; *p != 'e'; p++){
+        if(*p >= '0' && *p <= '9'){
+            digits[ndigits++] = *p;
+        }
+    }
+    exponent = atoi(p + 1);
+    while(ndigits > 1 && digits[ndigits - 1] == '0'){
+        ndigits--;
+    }
+    _write_decimal(negative, digits, ndigits, exponent, json);
+}
+
+#ifdef MORLOC_RUNTIME_IMPLEMENTATION
+// Scan a JSON number at json[i] into a decimal mantissa and exponent (value
+// = mantissa * 10^exponent). At most 19 significant digits are kept, `exact`
+// is cleared if any nonzero digit had to be dropped.
+bool _scan_number(const std::string &json, size_t &i, bool &negative, unsigned long long &mantissa, int &exponent, bool &exact){
+    const int max_digits = 19;
+    int ndigits = 0;
+    negative = false;
+    mantissa = 0;
+    exponent = 0;
+    exact = true;
+
+    if(json[i] == '-'){
+        negative = true;
+        i++;
+    }
+    if(json[i] < '0' || json[i] > '9'){
+        return false;
+    }
+    for(; json[i] >= '0' && json[i] <= '9'; i++){
+        if(ndigits < max_digits){
+            mantissa = 10 * mantissa + (json[i] - '0');
+            ndigits += mantissa > 0;
+        } else {
+            exact = exact && json[i] == '0';
+            exponent++;
+        }
+    }
+    if(json[i] == '.'){
+        i++;
+        for(; json[i] >= '0' && json[i] <= '9'; i++){
+            if(ndigits < max_digits){
+                mantissa = 10 * mantissa + (json[i] - '0');
+                ndigits += mantissa > 0;
+                exponent--;
+            } else {
+                exact = exact && json[i] == '0';
+            }
+        }
+    }
+    if(json[i] == 'e' || json[i] == 'E'){
+        size_t j = i + 1;
+        bool negative_exponent = false;
+        if(json[j] == '-' || json[j] == '+'){
+            negative_exponent = json[j] == '-';
+            j++;
+        }
+        if(json[j] >= '0' && json[j] <= '9'){
+            int e = 0;
+            for(; json[j] >= '0' && json[j] <= '9'; j++){
+                if(e < 100000){
+                    e = 10 * e + (json[j] - '0');
+                }
+            }
+            exponent += negative_exponent ? -e : e;
+            i = j;
+        }
+    }
+    return true;
+}
+#endif
+
+template <class A>
+bool _deserialize_real(const std::string &json, size_t &i, A &x){
+    size_t start = i;
+    bool negative, exact;
+    unsigned long long mantissa;
+    int exponent;
+    if(! _scan_number(json, i, negative, mantissa, exponent, exact)){
         return false;
     }
+    const int max_pow10 = _real_traits<A>::max_pow10;
+    if(exact && mantissa <= (1ULL << std::numeric_limits<A>::digits) &&
+       exponent >= -max_pow10 && exponent <= max_pow10){
+        x = (A)mantissa;
+        if(exponent < 0){
+            x /= (A)_exact_pow10[-exponent];
+        } else {
+            x *= (A)_exact_pow10[exponent];
+        }
+        if(negative){
+            x = -x;
+        }
+    } else {
+        // the scanned token is read in place, so nothing is copied
+        const char* begin = json.c_str() + start;
+        if(! _real_traits<A>::read(begin, begin + (i - start), x)){
+            i = start;
+            return false;
+        }
+    }
+    return true;
 }
 
+
 /* ---------------------------------------------------------------------- */
 /*                      D E S E R I A L I Z A T I O N                     */
 /* ---------------------------------------------------------------------- */
@@ -263,13 +1625,13 @@ bool try_parse(std::string json, size_t &i, A &x, bool (*f)(std::string, size_t
 // All combinator functions have the following general signature:
 //
 //   template <class A>
-//   bool deserialize(const std::string json, size_t &i, A &x)
+//   bool deserialize(const std::string &json, size_t &i, A &x)
 
 // The return value represents parse success.
 // The index may be incremented even on failure.
 
 // combinator parser for bool
-bool deserialize(const std::string json, size_t &i, bool &x){
+inline bool deserialize(const std::string &json, size_t &i, bool &x){
     if(match(json, "true", i)){
         x = true;
     }
@@ -283,107 +1645,163 @@ bool deserialize(const std::string json, size_t &i, bool &x){
 }
 
 // combinator parser for doubles
-bool deserialize(const std::string json, size_t &i, double &x){
-    std::string lhs = "";
-    std::string rhs = "";
-    char sign = '+';
-    
-    if(json[i] == '-'){
-        sign = '-';
-        i++;
+inline bool deserialize(const std::string &json, size_t &i, double &x){
+    return _deserialize_real(json, i, x);
+}
+
+// combinator parser for floats
+inline bool deserialize(const std::string &json, size_t &i, float &x){
+    return _deserialize_real(json, i, x);
+}
+
+#ifdef MORLOC_RUNTIME_IMPLEMENTATION
+// Read four hex digits at json[i]
+bool _read_hex4(const std::string &json, size_t &i, uint32_t &code){
+    if(i + 4 > json.size()){
+        return false;
     }
-    lhs = digit_str(json, i);
-    if(json[i] == '.'){
-        i++;
-        rhs = digit_str(json, i);
-    } else {
-        rhs = "0";
+    code = 0;
+    for(size_t end = i + 4; i < end; i++){
+        char c = json[i];
+        code <<= 4;
+        if(c >= '0' && c <= '9'){
+            code |= c - '0';
+        } else if(c >= 'a' && c <= 'f'){
+            code |= c - 'a' + 10;
+        } else if(c >= 'A' && c <= 'F'){
+            code |= c - 'A' + 10;
+        } else {
+            return false;
+        }
     }
+    return true;
+}
 
-    if(lhs.size() > 0){
-        x = read_double(sign + lhs + '.' + rhs);  
-        return true;
+void _utf8_append(uint32_t code, std::string &x){
+    if(code < 0x80){
+        x += (char)code;
+    } else if(code < 0x800){
+        x += (char)(0xC0 | (code >> 6));
+        x += (char)(0x80 | (code & 0x3F));
+    } else if(code < 0x10000){
+        x += (char)(0xE0 | (code >> 12));
+        x += (char)(0x80 | ((code >> 6) & 0x3F));
+        x += (char)(0x80 | (code & 0x3F));
     } else {
-        return false;
+        x += (char)(0xF0 | (code >> 18));
+        x += (char)(0x80 | ((code >> 12) & 0x3F));
+        x += (char)(0x80 | ((code >> 6) & 0x3F));
+        x += (char)(0x80 | (code & 0x3F));
     }
 }
 
-// combinator parser for floats
-// FIXME: remove this code duplication
-bool deserialize(const std::string json, size_t &i, float &x){
-    std::string lhs = "";
-    std::string rhs = "";
-    char sign = '+';
-    
-    if(json[i] == '-'){
-        sign = '-';
-        i++;
+// Read the escape sequence that starts with the backslash at json[i] and
+// append the character it stands for. A surrogate pair of \u escapes is
+// joined into one character, a lone surrogate is kept as it is.
+bool _json_unescape(const std::string &json, size_t &i, std::string &x){
+    if(i + 1 >= json.size()){
+        return false;
     }
-    lhs = digit_str(json, i);
-    if(json[i] == '.'){
-        i++;
-        rhs = digit_str(json, i);
-    } else {
-        rhs = "0";
+    char c = json[i + 1];
+    i += 2;
+    switch(c){
+        case '"': x += '"'; return true;
+        case '\\': x += '\\'; return true;
+        case '/': x += '/'; return true;
+        case 'b': x += '\b'; return true;
+        case 'f': x += '\f'; return true;
+        case 'n': x += '\n'; return true;
+        case 'r': x += '\r'; return true;
+        case 't': x += '\t'; return true;
+        case 'u': break;
+        default: return false;
     }
-
-    if(lhs.size() > 0){
-        x = read_float(sign + lhs + '.' + rhs);  
-        return true;
-    } else {
+    uint32_t code;
+    if(! _read_hex4(json, i, code)){
         return false;
     }
+    if(code >= 0xD800 && code < 0xDC00 && i + 1 < json.size() && json[i] == '\\' && json[i + 1] == 'u'){
+        size_t j = i + 2;
+        uint32_t low;
+        if(_read_hex4(json, j, low) && low >= 0xDC00 && low < 0xE000){
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            i = j;
+        }
+    }
+    _utf8_append(code, x);
+    return true;
 }
 
-// combinator parser for double-quoted strings
-bool deserialize(const std::string json, size_t &i, std::string &x){
-    try {
-        x = "";
-        if(! match(json, "\"", i)){
-            throw 1;
-        }
-        // TODO: add full JSON specification support (escapes, magic chars, etc)
-        while(i < json.size() && json[i] != '"'){
-            x += json[i];
+// combinator parser for double-quoted strings, runs of characters that are
+// not escaped are copied at once
+bool deserialize(const std::string &json, size_t &i, std::string &x){
+    x.clear();
+    if(! match(json, "\"", i)){
+        return false;
+    }
+    size_t start = i;
+    while(i < json.size()){
+        char c = json[i];
+        if(c == '"'){
+            x.append(json, start, i - start);
+            i++;
+            return true;
+        } else if(c == '\\'){
+            x.append(json, start, i - start);
+            if(! _json_unescape(json, i, x)){
+                return false;
+            }
+            start = i;
+        } else {
             i++;
         }
-        if(! match(json, "\"", i)){
-            throw 1;
-        }
-    } catch (int e) {
-        return false;
     }
-    return true;
+    return false;
 }
+#endif
 
 template <class A>
-bool integer_deserialize(const std::string json, size_t &i, A &x){
-    char sign = '+';
+bool integer_deserialize(const std::string &json, size_t &i, A &x){
+    bool negative = false;
     if(json[i] == '-'){
-        sign = '-';
+        // a negative number never fits an unsigned type
+        if(! std::numeric_limits<A>::is_signed){
+            return false;
+        }
+        negative = true;
         i++;
     }
-    std::string x_str = digit_str(json, i);
-    if(x_str.size() > 0){
-        std::stringstream sstream(sign + x_str);
-        sstream >> x;
-        return true;
+    if(json[i] < '0' || json[i] > '9'){
+        return false;
+    }
+    // the largest magnitude A can hold with this sign
+    const unsigned long long limit = negative
+        ? 0ULL - (unsigned long long)std::numeric_limits<A>::min()
+        : (unsigned long long)std::numeric_limits<A>::max();
+    unsigned long long magnitude = 0;
+    for(; json[i] >= '0' && json[i] <= '9'; i++){
+        unsigned long long digit = json[i] - '0';
+        if(magnitude > (limit - digit) / 10){
+            return false;
+        }
+        magnitude = 10 * magnitude + digit;
     }
-    return false; 
+    x = negative ? (A)(0 - magnitude) : (A)magnitude;
+    return true;
 }
-bool deserialize(const std::string json, size_t &i, int &x){
+inline bool deserialize(const std::string &json, size_t &i, int &x){
     return integer_deserialize(json, i, x);
 }
-bool deserialize(const std::string json, size_t &i, size_t &x){
+inline bool deserialize(const std::string &json, size_t &i, size_t &x){
     return integer_deserialize(json, i, x);
 }
-bool deserialize(const std::string json, size_t &i, long &x){
+inline bool deserialize(const std::string &json, size_t &i, long &x){
     return integer_deserialize(json, i, x);
 }
 
 // parser for vectors
 template <class A>
-bool deserialize(const std::string json, size_t &i, std::vector<A> &x){
+bool deserialize(const std::string &json, size_t &i, std::vector<A> &x){
     x = {};
     try {
         if(! match(json, "[", i)){
@@ -393,7 +1811,7 @@ bool deserialize(const std::string json, size_t &i, std::vector<A> &x){
         while(true){
             A element;
             if(deserialize(json, i, element)){
-                x.push_back(element);
+                x.push_back(std::move(element));
                 whitespace(json, i);
                 match(json, ",", i);
                 whitespace(json, i);
@@ -412,7 +1830,7 @@ bool deserialize(const std::string json, size_t &i, std::vector<A> &x){
 }
 
 template <class A>
-bool _deserialize_tuple(const std::string json, size_t &i, std::tuple<A> &x){
+bool _deserialize_tuple(const std::string &json, size_t &i, std::tuple<A> &x){
     A a;
     if(! deserialize(json, i, a)){
         return false;
@@ -421,7 +1839,7 @@ bool _deserialize_tuple(const std::string json, size_t &i, std::tuple<A> &x){
     return true;
 }
 template <class A, class... Rest>
-bool _deserialize_tuple(const std::string json, size_t &i, std::tuple<A, Rest...> &x){
+bool _deserialize_tuple(const std::string &json, size_t &i, std::tuple<A, Rest...> &x){
     A a;
     // parse the next element
     if(! deserialize(json, i, a)){
@@ -443,7 +1861,7 @@ bool _deserialize_tuple(const std::string json, size_t &i, std::tuple<A, Rest...
     return true;
 }
 template <class... Rest>
-bool deserialize(const std::string json, size_t &i, std::tuple<Rest...> &x){
+bool deserialize(const std::string &json, size_t &i, std::tuple<Rest...> &x){
     try {
         if(! match(json, "[", i)){
             throw 1;
@@ -462,17 +1880,230 @@ bool deserialize(const std::string json, size_t &i, std::tuple<Rest...> &x){
     return true;
 }
 
+/* ---------------------------------------------------------------------- */
+/*                             B I N A R Y                                */
+/* ---------------------------------------------------------------------- */
+
+// The binary wire format is driven by the same schemas as JSON. Integers are
+// written as 8-byte and reals as IEEE 8-byte little-endian values, booleans as
+// one byte, strings and lists as a 4-byte little-endian length followed by
+// their contents, and tuples and records as their fields in order. The format
+// must stay in step with the Python and R pool codecs.
+//
+// Pools pass data to each other in length-prefixed messages, so a binary
+// buffer travels as its raw bytes. It is tagged with a leading '@', which can
+// never start a JSON value.
+
+inline void _binary_write(uint64_t x, int nbytes, std::string &buf){
+    for(int k = 0; k < nbytes; k++){
+        buf += (char)((x >> (8 * k)) & 0xff);
+    }
+}
+
+inline bool _binary_read(const std::string &buf, size_t &i, int nbytes, uint64_t &x){
+    if(i + nbytes > buf.size()){
+        return false;
+    }
+    x = 0;
+    for(int k = 0; k < nbytes; k++){
+        x |= (uint64_t)(unsigned char)buf[i + k] << (8 * k);
+    }
+    i += nbytes;
+    return true;
+}
+
+inline void _binary_write_length(size_t n, std::string &buf){
+    if(n > 0xffffffffULL){
+        throw std::length_error("Container is too large for the binary wire format");
+    }
+    _binary_write(n, 4, buf);
+}
+
+inline void _binary_write_real(double x, std::string &buf){
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof bits);
+    _binary_write(bits, 8, buf);
+}
+
+inline bool _binary_read_real(const std::string &buf, size_t &i, double &x){
+    uint64_t bits;
+    if(! _binary_read(buf, i, 8, bits)){
+        return false;
+    }
+    memcpy(&x, &bits, sizeof x);
+    return true;
+}
+
 template <class A>
-A deserialize(const std::string json, A output){
-    size_t i = 0;
-    deserialize(json, i, output);
-    return output;
+bool _binary_read_integer(const std::string &buf, size_t &i, A &x){
+    uint64_t bits;
+    if(! _binary_read(buf, i, 8, bits)){
+        return false;
+    }
+    x = (A)(int64_t)bits;
+    return true;
+}
+
+inline void binary_serialize(bool x, bool schema, std::string &buf){
+    buf += x ? '\1' : '\0';
+}
+inline void binary_serialize(int x, int schema, std::string &buf){
+    _binary_write((uint64_t)(int64_t)x, 8, buf);
+}
+inline void binary_serialize(size_t x, size_t schema, std::string &buf){
+    _binary_write((uint64_t)x, 8, buf);
+}
+inline void binary_serialize(long x, long schema, std::string &buf){
+    _binary_write((uint64_t)(int64_t)x, 8, buf);
+}
+inline void binary_serialize(double x, double schema, std::string &buf){
+    _binary_write_real(x, buf);
+}
+inline void binary_serialize(float x, float schema, std::string &buf){
+    _binary_write_real((double)x, buf);
+}
+inline void binary_serialize(const std::string &x, const std::string &schema, std::string &buf){
+    _binary_write_length(x.size(), buf);
+    buf += x;
+}
+
+template <class A>
+void binary_serialize(const std::vector<A> &x, const std::vector<A> &schema, std::string &buf){
+    A element_schema{};
+    _binary_write_length(x.size(), buf);
+    for(size_t i = 0; i < x.size(); i++){
+        binary_serialize(x[i], element_schema, buf);
+    }
+}
+
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I == sizeof...(Rs), void>::type
+  _binary_serialize_tuple(const std::tuple<Rs...> &x, std::string &buf)
+  { }
+
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I < sizeof...(Rs), void>::type
+  _binary_serialize_tuple(const std::tuple<Rs...> &x, std::string &buf)
+  {
+    binary_serialize(std::get<I>(x), std::get<I>(x), buf);
+    _binary_serialize_tuple<I + 1, Rs...>(x, buf);
+  }
+
+template <class... A>
+void binary_serialize(const std::tuple<A...> &x, const std::tuple<A...> &schema, std::string &buf){
+    _binary_serialize_tuple<0, A...>(x, buf);
+}
+
+inline bool binary_deserialize(const std::string &buf, size_t &i, bool &x){
+    if(i >= buf.size()){
+        return false;
+    }
+    x = buf[i++] != '\0';
+    return true;
+}
+inline bool binary_deserialize(const std::string &buf, size_t &i, int &x){
+    return _binary_read_integer(buf, i, x);
+}
+inline bool binary_deserialize(const std::string &buf, size_t &i, size_t &x){
+    return _binary_read_integer(buf, i, x);
+}
+inline bool binary_deserialize(const std::string &buf, size_t &i, long &x){
+    return _binary_read_integer(buf, i, x);
+}
+inline bool binary_deserialize(const std::string &buf, size_t &i, double &x){
+    return _binary_read_real(buf, i, x);
+}
+inline bool binary_deserialize(const std::string &buf, size_t &i, float &x){
+    double y;
+    if(! _binary_read_real(buf, i, y)){
+        return false;
+    }
+    x = (float)y;
+    return true;
+}
+inline bool binary_deserialize(const std::string &buf, size_t &i, std::string &x){
+    uint64_t n;
+    if(! _binary_read(buf, i, 4, n) || i + n > buf.size()){
+        return false;
+    }
+    x.assign(buf, i, n);
+    i += n;
+    return true;
 }
 
+template <class A>
+bool binary_deserialize(const std::string &buf, size_t &i, std::vector<A> &x){
+    uint64_t n;
+    if(! _binary_read(buf, i, 4, n)){
+        return false;
+    }
+    x.clear();
+    // the count is untrusted, every element takes at least one byte, so no
+    // more elements can be left than bytes
+    x.reserve(std::min(n, (uint64_t)(buf.size() - i)));
+    for(uint64_t k = 0; k < n; k++){
+        A element;
+        if(! binary_deserialize(buf, i, element)){
+            return false;
+        }
+        x.push_back(std::move(element));
+    }
+    return true;
+}
+
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I == sizeof...(Rs), bool>::type
+  _binary_deserialize_tuple(const std::string &buf, size_t &i, std::tuple<Rs...> &x)
+  {
+    return true;
+  }
+
+template<std::size_t I, class... Rs>
+inline typename std::enable_if<I < sizeof...(Rs), bool>::type
+  _binary_deserialize_tuple(const std::string &buf, size_t &i, std::tuple<Rs...> &x)
+  {
+    return binary_deserialize(buf, i, std::get<I>(x))
+        && _binary_deserialize_tuple<I + 1, Rs...>(buf, i, x);
+  }
+
 template <class... Rest>
-std::tuple<Rest...> deserialize(const std::string json, std::tuple<Rest...> output){
+bool binary_deserialize(const std::string &buf, size_t &i, std::tuple<Rest...> &x){
+    return _binary_deserialize_tuple<0, Rest...>(buf, i, x);
+}
+
+// The top-level wire serializer, JSON is written exactly as before
+template <class A>
+std::string serialize(const A &x, const A &schema, morloc_wire_t wire){
+    if(wire == MORLOC_WIRE_JSON){
+        return serialize(x, schema);
+    }
+    std::string frame = "@";
+    binary_serialize(x, schema, frame);
+    return frame;
+}
+
+// The top-level deserializers accept either JSON or a binary frame
+template <class A>
+A _deserialize_frame(const std::string &data, A output){
     size_t i = 0;
-    deserialize(json, i, output);
+    if(data.size() > 0 && data[0] == '@'){
+        i = 1;
+        binary_deserialize(data, i, output);
+    } else {
+        deserialize(data, i, output);
+    }
     return output;
 }
+
+template <class A>
+A deserialize(const std::string &json, A output){
+    return _deserialize_frame(json, output);
+}
+
+template <class... Rest>
+std::tuple<Rest...> deserialize(const std::string &json, std::tuple<Rest...> output){
+    return _deserialize_frame(json, output);
+}
+
+#endif
 |]
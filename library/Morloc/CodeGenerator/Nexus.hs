@@ -2,7 +2,7 @@
 
 {-|
 Module      : Morloc.CodeGenerator.Nexus
-Description : Templates for generating a Perl nexus
+Description : Templates for generating a Perl or C++ nexus
 Copyright   : (c) Zebulun Arendsee, 2021
 License     : GPL-3
 Maintainer  : zbwrnz@gmail.com
@@ -23,7 +23,7 @@ import qualified Morloc.Language as ML
 import qualified Morloc.Monad as MM
 
 type FData =
-  ( MDoc -- pool call command, (e.g., "RScript pool.R 4 --")
+  ( [MDoc] -- pool call command words, (e.g., ["RScript", "pool.R", "4"])
   , MDoc -- subcommand name
   , TypeP -- argument type
   )
@@ -32,11 +32,16 @@ generate :: [NexusCommand] -> [(TypeP, Int, Maybe EVar)] -> MorlocMonad Script
 generate cs xs = do
   let names = [pretty name | (_, _, Just name) <- xs] ++ map (pretty . commandName) cs
   fdata <- CM.mapM getFData [(t, i, n) | (t, i, Just n) <- xs] -- [FData]
+  daemons <- MM.asks configPoolDaemons
+  nexus <- MM.asks configNexus
+  let (lang, code) = case nexus of
+        PerlNexus -> (ML.PerlLang, main daemons names fdata cs)
+        CppNexus -> (ML.CppLang, cppMain daemons names fdata cs)
   return $
     Script
       { scriptBase = "nexus"
-      , scriptLang = ML.PerlLang
-      , scriptCode = Code . render $ main names fdata cs
+      , scriptLang = lang
+      , scriptCode = Code . render $ code
       , scriptCompilerFlags = []
       , scriptInclude = []
       }
@@ -46,13 +51,13 @@ getFData (t, i, n) = do
   config <- MM.ask
   let lang = langOf t
   case MC.buildPoolCallBase config lang i of
-    (Just cmds) -> return (hsep cmds, pretty n, t)
+    (Just cmds) -> return (cmds, pretty n, t)
     Nothing ->
       MM.throwError . GeneratorError $
       "No execution method found for language: " <> ML.showLangName (fromJust lang)
 
-main :: [MDoc] -> [FData] -> [NexusCommand] -> MDoc
-main names fdata cdata =
+main :: Bool -> [MDoc] -> [FData] -> [NexusCommand] -> MDoc
+main daemons names fdata cdata =
   [idoc|#!/usr/bin/env perl
 
 use strict;
@@ -60,9 +65,15 @@ use warnings;
 
 use JSON::XS;
 
-my $json = JSON::XS->new->canonical;
-
-&printResult(&dispatch(@ARGV));
+# arguments, requests and replies are all UTF-8 encoded JSON
+my $json = JSON::XS->new->utf8->canonical->allow_nonref;
+#{daemonT}
+#{if daemons then "&start_daemons();" else ""}
+if(scalar(@ARGV) == 1 && $ARGV[0] eq '--batch'){
+    &batch();
+} else {
+    &printResult(&dispatch(@ARGV));
+}
 
 sub printResult {
     my $result = shift;
@@ -95,10 +106,196 @@ sub dispatch {
 
 #{usageT fdata cdata}
 
+#{batchT fdata cdata}
+
 #{vsep (map functionCT cdata ++ map functionT fdata)}
 
 |]
 
+-- Pools run as daemons that listen on Unix sockets in a temporary directory,
+-- or on a loopback TCP port written to a file there (all an R pool has).
+-- A pool is started by the first call made to it and the daemons are stopped
+-- when the nexus exits.
+daemonT :: MDoc
+daemonT = [idoc|
+use File::Temp qw(tempdir);
+
+my $socket_dir;
+
+sub start_daemons {
+    $socket_dir = tempdir("morloc-XXXXXX", TMPDIR => 1, CLEANUP => 1);
+    $ENV{MORLOC_SOCKET_DIR} = $socket_dir;
+}
+
+END {
+    if(defined $socket_dir){
+        for my $pidfile (glob("$socket_dir/*.pid")){
+            if(open(my $fh, "<", $pidfile)){
+                my $pid = <$fh>;
+                close($fh);
+                chomp $pid;
+                kill "TERM", $pid;
+            }
+        }
+    }
+}
+|]
+
+-- The batch mode runs newline-delimited JSON requests read from STDIN. Every
+-- pool runs as a daemon for the length of the batch, so it starts at most once
+-- however many requests use it. Requests and replies are framed as in the
+-- pools: a 4-byte little-endian count followed by length-prefixed strings.
+batchT :: [FData] -> [NexusCommand] -> MDoc
+batchT fdata cdata = [idoc|
+# Each line of STDIN is a request of the form {"cmd": NAME, "args": [ARG, ...]}
+# and one line is written to STDOUT for each request, in order. A failed
+# request is reported on STDERR and its result is null.
+sub batch {
+    require IO::Socket::INET;
+    require IO::Socket::UNIX;
+    require IPC::Open2;
+    require POSIX;
+
+    #{batchMapT fdata cdata}
+
+    &start_daemons() unless defined $socket_dir;
+    local $SIG{PIPE} = 'IGNORE';
+    local $| = 1;
+
+    my $line_number = 0;
+    while(my $line = <STDIN>){
+        $line_number++;
+        next if $line =~ /^\s*$/;
+        my $result = eval {
+            my $request = $json->decode($line);
+            my $cmd = $request->{cmd} // "";
+            my @args = map { $json->encode($_) } @{$request->{args} // []};
+            exists($batch_cmds{$cmd}) or die "Command '$cmd' not found\n";
+            my ($n, $f) = @{$batch_cmds{$cmd}};
+            if(scalar(@args) != $n){
+                die "Expected $n arguments to '$cmd', given " . scalar(@args) . "\n";
+            }
+            $f->(@args);
+        };
+        if(defined $result){
+            chomp $result;
+            print "$result\n";
+        } else {
+            chomp(my $error = $@);
+            print STDERR "Request $line_number failed: $error\n";
+            print "null\n";
+        }
+    }
+}
+
+sub pack_strings {
+    my $msg = pack("V", scalar(@_));
+    for my $x (@_){
+        $msg .= pack("V", length($x)) . $x;
+    }
+    return $msg;
+}
+
+sub read_exact {
+    my ($fh, $n) = @_;
+    my $data = "";
+    while(length($data) < $n){
+        my $got = read($fh, $data, $n - length($data), length($data));
+        $got or die "Unexpected end of a pool message\n";
+    }
+    return $data;
+}
+
+sub recv_strings {
+    my $fh = shift;
+    my $n = unpack("V", &read_exact($fh, 4));
+    return map { &read_exact($fh, unpack("V", &read_exact($fh, 4))) } 1 .. $n;
+}
+
+# Connect to the daemon at `path`, through its Unix socket or else through the
+# TCP port and token written to `path.port`, which R daemons listen on
+sub daemon_connect {
+    my $path = shift;
+    my $conn = IO::Socket::UNIX->new(Peer => $path);
+    return $conn if $conn;
+    open(my $fh, "<", "$path.port") or return undef;
+    my ($port, $token) = split(' ', <$fh> // "");
+    close($fh);
+    defined($token) or return undef;
+    $conn = IO::Socket::INET->new(PeerAddr => "127.0.0.1", PeerPort => $port, Proto => "tcp")
+        or return undef;
+    binmode($conn);
+    print $conn $token;
+    return $conn;
+}
+
+# Connect to the daemon serving a pool, starting it if it is not running.
+# Returns undef if the pool cannot run as a daemon.
+sub daemon_open {
+    my ($path, @cmd) = @_;
+    my $conn = &daemon_connect($path);
+    return $conn if $conn || -e "$path.nodaemon";
+    my $pid = fork();
+    defined($pid) or die "Failed to start pool '$cmd[-1]'\n";
+    if($pid == 0){
+        POSIX::setsid();
+        open(STDIN, "<", "/dev/null");
+        open(STDOUT, ">", "/dev/null");
+        exec(@cmd, "--daemon", $path) or POSIX::_exit(1);
+    }
+    # wait for the daemon to listen, giving up if it exits first
+    for (1 .. 3000){
+        $conn = &daemon_connect($path);
+        last if $conn || -e "$path.nodaemon" || waitpid($pid, POSIX::WNOHANG()) == $pid;
+        select(undef, undef, undef, 0.01);
+    }
+    return $conn;
+}
+
+# The last element of `cmd` is the manifold id, the reply is always JSON
+sub pool_request {
+    my ($cmd, @args) = @_;
+    my @words = @$cmd;
+    my $mid = pop(@words);
+    my $request = &pack_strings($mid, "json", @args);
+    my $path = $socket_dir . "/" . ($words[-1] =~ s{.*/}{}r);
+
+    my $conn = &daemon_open($path, @words);
+    if($conn){
+        binmode($conn);
+        print $conn $request;
+        my ($status, $result) = &recv_strings($conn);
+        close($conn);
+        $status eq "0" or die "$result\n";
+        return $result;
+    }
+
+    # the pool cannot run as a daemon, so it is started for this request
+    my $pid = IPC::Open2::open2(my $out, my $in, @words, "--stdin");
+    binmode($in);
+    binmode($out);
+    print $in $request;
+    close($in);
+    my $result = do { local $/; <$out> } // "";
+    close($out);
+    waitpid($pid, 0);
+    $? == 0 or die "Pool '$words[-1]' failed\n";
+    return $result;
+}
+|]
+
+batchMapT :: [FData] -> [NexusCommand] -> MDoc
+batchMapT fdata cdata =
+  [idoc|my %batch_cmds = #{tupled (map batchPoolT fdata ++ map batchConstT cdata)};|]
+
+batchPoolT :: FData -> MDoc
+batchPoolT (cmd, name, t) =
+  [idoc|#{name} => [#{pretty (nargs t)}, sub { &pool_request([#{hcat (punctuate ", " (map dquotes cmd))}], @_) }]|]
+
+batchConstT :: NexusCommand -> MDoc
+batchConstT cmd =
+  [idoc|#{pretty (commandName cmd)} => [#{pretty (length (commandArgs cmd))}, \&call_#{pretty (commandName cmd)}]|]
+
 mapT names = [idoc|my %cmds = #{tupled (map mapEntryT names)};|]
 
 mapEntryT n = [idoc|#{n} => \&call_#{n}|]
@@ -159,7 +356,7 @@ sub call_#{name}{
 |]
   where
     n = nargs t
-    poolcall = hsep $ cmd : map argT [0 .. (n - 1)]
+    poolcall = hsep $ cmd ++ map argT [0 .. (n - 1)]
 
 functionCT :: NexusCommand -> MDoc
 functionCT (NexusCommand cmd _ json_str args subs) =
@@ -175,7 +372,7 @@ sub call_#{pretty cmd}{
 }
 |]
   where
-    readArguments = zipWith readJsonArg args [1..]
+    readArguments = zipWith readJsonArg args [0..]
     replacements = map (uncurry3 replaceJson) subs
 
 replaceJson :: JsonPath -> MT.Text -> JsonPath -> MDoc
@@ -193,7 +390,347 @@ pathElement (JsonIndex i) = brackets (pretty i)
 pathElement (JsonKey key) = braces (pretty key)
 
 readJsonArg ::EVar -> Int -> MDoc
-readJsonArg v i = [idoc|my $json_#{pretty v} = $json->decode($ARGV[#{pretty i}]); |]
+readJsonArg v i = [idoc|my $json_#{pretty v} = $json->decode($_[#{pretty i}]); |]
 
 argT :: Int -> MDoc
 argT i = "'$_[" <> pretty i <> "]'" 
+
+
+-- | A compiled nexus. Pool commands execute directly into the pool, so a call
+-- costs one process launch rather than a Perl interpreter, a shell and the
+-- pool. Constant commands substitute their arguments into stored JSON.
+cppMain :: Bool -> [MDoc] -> [FData] -> [NexusCommand] -> MDoc
+cppMain daemons names fdata cdata =
+  [idoc|#include <dirent.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern char **environ;
+
+// JSON values are kept as text, only objects and arrays are parsed so that
+// arguments can be substituted into them. Objects are written with sorted
+// keys.
+struct json_t {
+    char kind; // 'o' for objects, 'a' for arrays, 'v' for any other value
+    std::string raw;
+    std::map<std::string, json_t> fields;
+    std::vector<json_t> items;
+
+    json_t& key(const std::string &k){
+        return fields.at(k);
+    }
+
+    json_t& index(size_t i){
+        return items.at(i);
+    }
+};
+
+void json_space(const std::string &s, size_t &i){
+    while(i < s.size() && strchr(" \t\r\n", s[i]) != NULL && s[i] != '\0'){
+        i++;
+    }
+}
+
+bool json_match(const std::string &s, size_t &i, char c){
+    json_space(s, i);
+    if(i < s.size() && s[i] == c){
+        i++;
+        return true;
+    }
+    return false;
+}
+
+std::string json_string(const std::string &s, size_t &i){
+    size_t start = i++;
+    while(i < s.size() && s[i] != '"'){
+        i += s[i] == '\\' ? 2 : 1;
+    }
+    if(i >= s.size()){
+        throw std::runtime_error("Unterminated JSON string");
+    }
+    i++;
+    return s.substr(start, i - start);
+}
+
+json_t json_parse(const std::string &s, size_t &i){
+    json_t x;
+    json_space(s, i);
+    if(i >= s.size()){
+        throw std::runtime_error("Unexpected end of JSON");
+    }
+    if(json_match(s, i, '{')){
+        x.kind = 'o';
+        if(json_match(s, i, '}')){
+            return x;
+        }
+        do {
+            json_space(s, i);
+            if(i >= s.size() || s[i] != '"'){
+                throw std::runtime_error("Expected a JSON key");
+            }
+            std::string k = json_string(s, i);
+            if(! json_match(s, i, ':')){
+                throw std::runtime_error("Expected ':' after a JSON key");
+            }
+            x.fields[k.substr(1, k.size() - 2)] = json_parse(s, i);
+        } while(json_match(s, i, ','));
+        if(! json_match(s, i, '}')){
+            throw std::runtime_error("Expected '}' in JSON");
+        }
+    } else if(json_match(s, i, '[')){
+        x.kind = 'a';
+        if(json_match(s, i, ']')){
+            return x;
+        }
+        do {
+            x.items.push_back(json_parse(s, i));
+        } while(json_match(s, i, ','));
+        if(! json_match(s, i, ']')){
+            throw std::runtime_error("Expected ']' in JSON");
+        }
+    } else if(s[i] == '"'){
+        x.kind = 'v';
+        x.raw = json_string(s, i);
+    } else {
+        x.kind = 'v';
+        size_t start = i;
+        while(i < s.size() && strchr(",]} \t\r\n", s[i]) == NULL){
+            i++;
+        }
+        x.raw = s.substr(start, i - start);
+        if(x.raw.empty()){
+            throw std::runtime_error("Expected a JSON value");
+        }
+    }
+    return x;
+}
+
+json_t json_read(const std::string &s){
+    size_t i = 0;
+    json_t x = json_parse(s, i);
+    json_space(s, i);
+    if(i != s.size()){
+        throw std::runtime_error("Unexpected trailing characters in JSON");
+    }
+    return x;
+}
+
+void json_write(const json_t &x, std::string &out){
+    if(x.kind == 'o'){
+        out += '{';
+        for(std::map<std::string, json_t>::const_iterator it = x.fields.begin(); it != x.fields.end(); ++it){
+            if(it != x.fields.begin()){
+                out += ',';
+            }
+            out += '"' + it->first + "\":";
+            json_write(it->second, out);
+        }
+        out += '}';
+    } else if(x.kind == 'a'){
+        out += '[';
+        for(size_t i = 0; i < x.items.size(); i++){
+            if(i > 0){
+                out += ',';
+            }
+            json_write(x.items[i], out);
+        }
+        out += ']';
+    } else {
+        out += x.raw;
+    }
+}
+#{if daemons then cppDaemonT else cppExecT}
+void usage(){
+    std::cerr << "The following commands are exported:\n";
+    #{align $ vsep (map cppUsageLineT fdata ++ map cppUsageLineConst cdata)}
+    exit(0);
+}
+
+#{vsep (map cppFunctionCT cdata ++ map cppFunctionT fdata)}
+
+int main(int argc, char * argv[]){
+    if(argc < 2){
+        usage();
+    }
+
+    std::string cmd = argv[1];
+    std::vector<std::string> args(argv + 2, argv + argc);
+
+    if(cmd == "-h" || cmd == "-?" || cmd == "--help" || cmd == "?"){
+        usage();
+    }
+
+    if(cmd == "--batch"){
+        std::cerr << "Batch mode (--batch) is only supported by the Perl nexus, rebuild with --nexus perl to use it" << std::endl;
+        return 1;
+    }
+
+    try {
+        #{align . vsep $ map cppDispatchT names}
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Command '" << cmd << "' not found" << std::endl;
+    usage();
+    return 1;
+}
+|]
+
+cppExecT :: MDoc
+cppExecT = [idoc|
+int run_pool(std::vector<std::string> cmd, const std::vector<std::string> &args){
+    cmd.insert(cmd.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for(size_t i = 0; i < cmd.size(); i++){
+        argv.push_back(const_cast<char*>(cmd[i].c_str()));
+    }
+    argv.push_back(NULL);
+    execvp(argv[0], argv.data());
+    std::cerr << "Failed to run pool '" << cmd[0] << "'" << std::endl;
+    return 1;
+}
+|]
+
+-- Pools run as daemons that listen on Unix sockets in a temporary directory.
+-- The nexus waits for the pool it calls and then stops the daemons.
+cppDaemonT :: MDoc
+cppDaemonT = [idoc|
+void stop_daemons(const std::string &dir){
+    std::vector<std::string> files;
+    DIR* handle = opendir(dir.c_str());
+    if(handle != NULL){
+        struct dirent* entry;
+        while((entry = readdir(handle)) != NULL){
+            std::string name = entry->d_name;
+            if(name != "." && name != ".."){
+                files.push_back(dir + "/" + name);
+            }
+        }
+        closedir(handle);
+    }
+    for(size_t i = 0; i < files.size(); i++){
+        const std::string &file = files[i];
+        if(file.size() > 4 && file.compare(file.size() - 4, 4, ".pid") == 0){
+            std::ifstream fh(file.c_str());
+            pid_t pid;
+            if(fh >> pid){
+                kill(pid, SIGTERM);
+            }
+        }
+        unlink(file.c_str());
+    }
+    rmdir(dir.c_str());
+}
+
+int run_pool(std::vector<std::string> cmd, const std::vector<std::string> &args){
+    cmd.insert(cmd.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for(size_t i = 0; i < cmd.size(); i++){
+        argv.push_back(const_cast<char*>(cmd[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    const char* tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp != NULL ? tmp : "/tmp") + "/morloc-XXXXXX";
+    if(mkdtemp(&dir[0]) == NULL){
+        throw std::runtime_error("Failed to create a socket directory in " + dir);
+    }
+    setenv("MORLOC_SOCKET_DIR", dir.c_str(), 1);
+
+    int status = 1;
+    pid_t pid;
+    if(posix_spawnp(&pid, argv[0], NULL, NULL, argv.data(), environ) == 0){
+        waitpid(pid, &status, 0);
+        status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    } else {
+        std::cerr << "Failed to run pool '" << cmd[0] << "'" << std::endl;
+    }
+    stop_daemons(dir);
+    return status;
+}
+|]
+
+cppDispatchT :: MDoc -> MDoc
+cppDispatchT n = [idoc|if(cmd == "#{n}"){ return call_#{n}(args); }|]
+
+cppUsageLineT :: FData -> MDoc
+cppUsageLineT (_, name, t) = vsep
+  ( [idoc|std::cerr << "  #{name}\n";|]
+  : cppWriteTypes (gtypeOf t)
+  )
+
+cppUsageLineConst :: NexusCommand -> MDoc
+cppUsageLineConst cmd = vsep
+  ( [idoc|std::cerr << "  #{pretty (commandName cmd)}\n";|]
+  : cppWriteTypes (commandType cmd)
+  )
+
+cppWriteTypes :: Type -> [MDoc]
+cppWriteTypes t =
+  let (inputs, output) = decompose t
+  in zipWith cppWriteType [Just i | i <- [1..]] inputs ++ [cppWriteType Nothing output]
+
+cppWriteType :: Maybe Int -> Type -> MDoc
+cppWriteType (Just i) t  = [idoc|std::cerr << R"morloc(    param #{pretty i}: #{prettyType t})morloc" << "\n";|]
+cppWriteType (Nothing) t = [idoc|std::cerr << R"morloc(    return: #{prettyType t})morloc" << "\n";|]
+
+cppArgCheckT :: MDoc -> Int -> MDoc
+cppArgCheckT name n = [idoc|if(args.size() != #{pretty n}){
+    std::cerr << "Expected #{pretty n} arguments to '#{name}', given " << args.size() << std::endl;
+    exit(1);
+}|]
+
+cppFunctionT :: FData -> MDoc
+cppFunctionT (cmd, name, t) =
+  [idoc|
+int call_#{name}(const std::vector<std::string> &args){
+    #{cppArgCheckT name (nargs t)}
+    return run_pool(#{encloseSep "{" "}" ", " (map dquotes cmd)}, args);
+}
+|]
+
+cppFunctionCT :: NexusCommand -> MDoc
+cppFunctionCT (NexusCommand cmd _ json_str args subs) =
+  [idoc|
+int call_#{pretty cmd}(const std::vector<std::string> &args){
+    #{cppArgCheckT (pretty cmd) (length args)}
+    json_t json_obj = json_read(R"morloc(#{json_str})morloc");
+    #{align . vsep $ readArguments ++ replacements}
+    std::string out;
+    json_write(json_obj, out);
+    std::cout << out << std::endl;
+    return 0;
+}
+|]
+  where
+    readArguments = zipWith cppReadJsonArg args [0..]
+    replacements = map (uncurry3 cppReplaceJson) subs
+
+cppReadJsonArg :: EVar -> Int -> MDoc
+cppReadJsonArg v i = [idoc|json_t json_#{pretty v} = json_read(args[#{pretty i}]);|]
+
+cppReplaceJson :: JsonPath -> MT.Text -> JsonPath -> MDoc
+cppReplaceJson pathTo v pathFrom
+  = cppAccess "json_obj" pathTo
+  <+> "="
+  <+> cppAccess [idoc|json_#{pretty v}|] pathFrom
+  <> ";"
+
+cppAccess :: MDoc -> JsonPath -> MDoc
+cppAccess v ps = cat (v : map cppPathElement ps)
+
+cppPathElement :: JsonAccessor -> MDoc
+cppPathElement (JsonIndex i) = ".index(" <> pretty i <> ")"
+cppPathElement (JsonKey key) = ".key(\"" <> pretty key <> "\")"
@@ -12,9 +12,12 @@ module Morloc.Config
   , loadDefaultMorlocConfig
   , buildPoolCallBase
   , getDefaultConfigFilepath
+  , readWireFormat
+  , readNexusBackend
+  , readBuildProfile
   ) where
 
-import Data.Aeson (FromJSON(..), (.!=), (.:?), withObject)
+import Data.Aeson (FromJSON(..), (.!=), (.:?), withObject, withText)
 import Morloc.Data.Doc
 import Morloc.Namespace
 import qualified Morloc.Language as ML
@@ -32,6 +35,44 @@ getDefaultConfigFilepath =
 instance FromJSON Path where
   parseJSON = fmap Path . parseJSON
 
+instance FromJSON WireFormat where
+  parseJSON = withText "WireFormat" $ \x -> case readWireFormat x of
+    (Just wire) -> return wire
+    Nothing -> fail $ "Unknown wire format '" <> MT.unpack x <> "', expected 'json' or 'binary'"
+
+-- | Parse the name of a wire format as given in the config file or on the
+-- command line
+readWireFormat :: MT.Text -> Maybe WireFormat
+readWireFormat "json" = Just JsonWire
+readWireFormat "binary" = Just BinaryWire
+readWireFormat _ = Nothing
+
+instance FromJSON NexusBackend where
+  parseJSON = withText "NexusBackend" $ \x -> case readNexusBackend x of
+    (Just nexus) -> return nexus
+    Nothing -> fail $ "Unknown nexus '" <> MT.unpack x <> "', expected 'perl' or 'cpp'"
+
+-- | Parse the name of a nexus backend as given in the config file or on the
+-- command line
+readNexusBackend :: MT.Text -> Maybe NexusBackend
+readNexusBackend "perl" = Just PerlNexus
+readNexusBackend "cpp" = Just CppNexus
+readNexusBackend _ = Nothing
+
+instance FromJSON BuildProfile where
+  parseJSON = withText "BuildProfile" $ \x -> case readBuildProfile x of
+    (Just profile) -> return profile
+    Nothing -> fail $ "Unknown build profile '" <> MT.unpack x <> "', expected 'debug', 'release', 'native' or 'pgo'"
+
+-- | Parse the name of a build profile as given in the config file or on the
+-- command line
+readBuildProfile :: MT.Text -> Maybe BuildProfile
+readBuildProfile "debug" = Just DebugBuild
+readBuildProfile "release" = Just ReleaseBuild
+readBuildProfile "native" = Just NativeBuild
+readBuildProfile "pgo" = Just PgoBuild
+readBuildProfile _ = Nothing
+
 -- FIXME: remove this chronic multiplication
 instance FromJSON Config where
   parseJSON =
@@ -43,6 +84,14 @@ instance FromJSON Config where
         <*> fmap Path (o .:? "lang_python3" .!= "python3")
         <*> fmap Path (o .:? "lang_R" .!= "Rscript")
         <*> fmap Path (o .:? "lang_perl" .!= "perl")
+        <*> (o .:? "wire_format" .!= JsonWire)
+        <*> (o .:? "pool_daemons" .!= False)
+        <*> (o .:? "pool_threads" .!= 4)
+        <*> (o .:? "nexus" .!= PerlNexus)
+        <*> (o .:? "result_cache" .!= 0)
+        <*> fmap (fmap Path) (o .:? "profile")
+        <*> (o .:? "build_profile" .!= ReleaseBuild)
+        <*> (o .:? "train")
 
 -- | Load the default Morloc configuration, ignoring any local configurations.
 loadDefaultMorlocConfig :: IO Config
@@ -56,6 +105,14 @@ loadDefaultMorlocConfig = do
       (Path "python") -- lang_python3
       (Path "Rscript") -- lang_R
       (Path "perl") -- lang_perl
+      JsonWire -- wire_format
+      False -- pool_daemons
+      4 -- pool_threads
+      PerlNexus -- nexus
+      0 -- result_cache
+      Nothing -- profile
+      ReleaseBuild -- build_profile
+      Nothing -- train
 
 -- | Load a Morloc config file. If no file is given (i.e., Nothing), then the
 -- default configuration will be used.
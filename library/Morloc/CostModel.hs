@@ -0,0 +1,172 @@
+{-|
+Module      : Morloc.CostModel
+Description : Costs of calls within and between languages
+Copyright   : (c) Zebulun Arendsee, 2021
+License     : GPL-3
+Maintainer  : zbwrnz@gmail.com
+Stability   : experimental
+
+The realize step chooses between language instances by the cost of the calls
+they imply, in nanoseconds. Without measurements, the rough constants in
+@Morloc.Language.pairwiseCost@ are used, scaled to nanoseconds. @morloc
+calibrate@ measures each installed language on the local machine and writes a
+cost profile that is used instead.
+
+A generated program run with the environment variable @MORLOC_PROFILE@ set
+appends a line to that file for every manifold it executes: the pool
+language, the source function the manifold calls, the size of its input in
+bytes and its wall time in nanoseconds. Given such a file, @morloc make
+--profile@ adds the expected run time of each sourced function to the cost of
+choosing it, so the faster of several instances is preferred.
+-}
+module Morloc.CostModel
+  ( CostModel(..)
+  , LangCost(..)
+  , emptyCostModel
+  , costProfilePath
+  , loadCostModel
+  , writeCostModel
+  , interopCost
+  , callCost
+  , unmeasuredScale
+  ) where
+
+import Morloc.Namespace
+import Data.Aeson (FromJSON(..), (.:), withObject)
+import qualified Data.Map as Map
+import qualified Data.Yaml as Y
+import qualified Morloc.Data.Text as MT
+import qualified Morloc.Language as ML
+import qualified Morloc.Monad as MM
+import qualified Morloc.System as MS
+
+-- | Measured costs of one language, all in nanoseconds
+data LangCost = LangCost
+  { costStartup :: Double
+  -- ^ starting a process that runs nothing
+  , costCall :: Double
+  -- ^ calling a function within a running process
+  , costByte :: Double
+  -- ^ serializing and then deserializing one byte of data
+  } deriving (Show, Eq, Ord)
+
+instance FromJSON LangCost where
+  parseJSON = withObject "LangCost" $ \o ->
+    LangCost <$> o .: "startup" <*> o .: "call" <*> o .: "byte"
+
+data CostModel = CostModel
+  { costLangs :: Map.Map Lang LangCost
+  -- ^ interop costs measured by @morloc calibrate@
+  , costCalls :: Map.Map (Lang, MT.Text) Double
+  -- ^ expected run time of a sourced function, estimated from a profile
+  } deriving (Show, Eq, Ord)
+
+emptyCostModel :: CostModel
+emptyCostModel = CostModel Map.empty Map.empty
+
+-- | The size of the data passed in a foreign call is not known when the
+-- program is built, so every call is assumed to pass this many bytes
+nominalBytes :: Double
+nominalBytes = 1000
+
+-- | Nanoseconds per unit of @pairwiseCost@. This puts its foreign calls near
+-- the startup times of the pools, so unmeasured pairs can be weighed against
+-- measured ones and against profiled run times.
+unmeasuredScale :: Int
+unmeasuredScale = 1000
+
+costProfilePath :: MorlocMonad Path
+costProfilePath = MM.asks (\c -> MS.combine (configHome c) (Path "costs.yaml"))
+
+-- | Load the cost profile written by @morloc calibrate@, if there is one, and
+-- the runtime profile given to @morloc make --profile@.
+loadCostModel :: MorlocMonad CostModel
+loadCostModel = do
+  langs <- loadLangCosts
+  calls <- MM.asks configProfile >>= maybe (return Map.empty) loadCallCosts
+  return $ CostModel langs calls
+
+-- | Entries for unknown languages are ignored
+loadLangCosts :: MorlocMonad (Map.Map Lang LangCost)
+loadLangCosts = do
+  path <- costProfilePath
+  exists <- liftIO $ MS.fileExists path
+  if not exists
+    then return Map.empty
+    else do
+      result <- liftIO $ Y.decodeFileEither (MT.unpack (unPath path))
+      case result of
+        (Left err) -> MM.throwError . OtherError $
+          "Invalid cost profile '" <> unPath path <> "': " <> MT.pack (Y.prettyPrintParseException err)
+        (Right costs) -> return $ Map.fromList
+          [(lang, cost) | (name, cost) <- Map.toList (costs :: Map.Map MT.Text LangCost)
+                        , Just lang <- [ML.readLangName name]]
+
+-- | Read the runtimes recorded by generated programs. Each line holds a
+-- language, a function name, an input size in bytes and a wall time in
+-- nanoseconds, separated by tabs. Malformed lines are skipped, since a pool
+-- that was killed may leave a partial line behind.
+loadCallCosts :: Path -> MorlocMonad (Map.Map (Lang, MT.Text) Double)
+loadCallCosts path = do
+  exists <- liftIO $ MS.fileExists path
+  if not exists
+    then MM.throwError . OtherError $ "Profile '" <> unPath path <> "' not found"
+    else do
+      lines' <- liftIO $ MT.lines <$> MT.readFile (MT.unpack (unPath path))
+      let samples = Map.fromListWith (++)
+            [ ((lang, name), [(bytes, ns)])
+            | [langName, name, bytesText, nsText] <- map (MT.splitOn "\t") lines'
+            , Just lang <- [ML.readLangName langName]
+            , Just bytes <- [MT.readMay' bytesText]
+            , Just ns <- [MT.readMay' nsText]
+            ]
+      return $ Map.map (estimate nominalBytes) samples
+
+-- | Fit the run time of a function as a line in the size of its input and
+-- evaluate it at the given size. If every recorded input had the same size,
+-- the mean run time is used.
+estimate :: Double -> [(Double, Double)] -> Double
+estimate x samples
+  | sxx == 0 = meanY
+  | otherwise = max 0 (meanY + slope * (x - meanX))
+  where
+    n = fromIntegral (length samples)
+    meanX = sum (map fst samples) / n
+    meanY = sum (map snd samples) / n
+    sxx = sum [(x' - meanX) ^ (2 :: Int) | (x', _) <- samples]
+    sxy = sum [(x' - meanX) * (y' - meanY) | (x', y') <- samples]
+    slope = sxy / sxx
+
+writeCostModel :: CostModel -> MorlocMonad Path
+writeCostModel model = do
+  path <- costProfilePath
+  liftIO . MT.writeFile (MT.unpack (unPath path)) . MT.unlines $
+    [ "# written by 'morloc calibrate', all costs are in nanoseconds" ] ++
+    concat [ [ ML.showLangName lang <> ":"
+             , "  startup: " <> MT.show' (costStartup c)
+             , "  call: " <> MT.show' (costCall c)
+             , "  byte: " <> MT.show' (costByte c)
+             ]
+           | (lang, c) <- Map.toList (costLangs model) ]
+  return path
+
+-- | The cost of a call from the first language into the second. A call within
+-- a language costs its call overhead. A foreign call also starts the callee's
+-- process and passes its data through both serializers. Pairs that were not
+-- measured fall back to @pairwiseCost@, scaled by 'unmeasuredScale'.
+interopCost :: CostModel -> Lang -> Lang -> Maybe Int
+interopCost model from to = case (ML.pairwiseCost from to, Map.lookup from langs, Map.lookup to langs) of
+  (Just _, Just c1, Just c2)
+    | from == to -> Just . ceiling $ costCall c2
+    | otherwise -> Just . ceiling $
+        costStartup c2 + costCall c2 + nominalBytes * (costByte c1 + costByte c2)
+  (cost, _, _) -> (* unmeasuredScale) <$> cost
+  where
+    langs = costLangs model
+
+-- | The expected run time of a sourced function, or 0 if it was never
+-- profiled. Functions are known by name, so all instances of a function in
+-- one language share an estimate.
+callCost :: CostModel -> Source -> Int
+callCost model src = maybe 0 ceiling $
+  Map.lookup (srcLang src, unName (srcName src)) (costCalls model)
@@ -24,6 +24,8 @@ module Morloc.Data.Text
   , undquote
   , stripPrefixIfPresent
   , liftToText
+  , fnv1a
+  , fnv1aBytes
   ) where
 
 import Data.Text hiding (map)
@@ -31,6 +33,10 @@ import Data.Text.Encoding
 import Data.Text.IO
 import qualified Data.Text.Lazy as DL
 import Prelude hiding (concat, length, lines, unlines)
+import Data.Bits (xor)
+import Data.Word (Word64, Word8)
+import qualified Data.ByteString as BS
+import qualified Numeric
 import qualified Safe
 import qualified Text.Pretty.Simple as Pretty
 
@@ -43,6 +49,19 @@ read' = read . unpack
 readMay' :: Read a => Text -> Maybe a
 readMay' = Safe.readMay . unpack
 
+-- | The 64-bit FNV-1a hash of the UTF-8 encoding of a text as 16 hex digits
+fnv1a :: Text -> Text
+fnv1a = fnv1aBytes . encodeUtf8
+
+-- | The 64-bit FNV-1a hash of a byte string as 16 hex digits
+fnv1aBytes :: BS.ByteString -> Text
+fnv1aBytes = hex . BS.foldl' step 14695981039346656037 where
+  step :: Word64 -> Word8 -> Word64
+  step h c = (h `xor` fromIntegral c) * 1099511628211
+
+  hex :: Word64 -> Text
+  hex h = justifyRight 16 '0' (pack (Numeric.showHex h ""))
+
 stripPrefixIfPresent :: Text -> Text -> Text
 stripPrefixIfPresent prefix text =
   case stripPrefix prefix text of
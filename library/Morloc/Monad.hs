@@ -21,6 +21,7 @@ module Morloc.Monad
   , logFileWith
   , readLang
   , say
+  , concurrently
   -- * reusable counter
   , startCounter
   , getCounter
@@ -32,6 +33,9 @@ module Morloc.Monad
   , module Control.Monad.Writer
   ) where
 
+import Control.Concurrent (forkIO, getNumCapabilities)
+import Control.Concurrent.MVar (newEmptyMVar, putMVar, takeMVar)
+import Control.Concurrent.QSem (newQSem, signalQSem, waitQSem)
 import Control.Monad.Except
 import Control.Monad.Reader
 import Control.Monad.State
@@ -41,6 +45,7 @@ import Morloc.Error () -- for MorlocError Show instance
 import Morloc.Namespace
 import Morloc.Data.Doc
 import System.IO (stderr)
+import qualified Control.Exception as CE
 import qualified Morloc.Data.Text as MT
 import qualified Morloc.Language as ML
 import qualified System.Directory as SD
@@ -94,6 +99,32 @@ runCommand loc cmd = do
 say :: MDoc -> MorlocMonad ()
 say d = liftIO . putDoc $ " : " <> d <> "\n"
 
+-- | Run actions in parallel, at most one per core, and return their results
+-- in order. Each action starts from the current state and its changes to the
+-- state are dropped, but its messages are kept. If any action fails, the
+-- error of the first failed action is raised once all have finished.
+concurrently :: [MorlocMonad a] -> MorlocMonad [a]
+concurrently actions = do
+  config <- ask
+  st <- get
+  vars <- liftIO $ do
+    slots <- getNumCapabilities >>= newQSem
+    mapM (fork slots config st) actions
+  results <- liftIO $ mapM takeMVar vars
+  mapM collect results
+  where
+    fork slots config st action = do
+      var <- newEmptyMVar
+      _ <- forkIO $ do
+        result <- CE.bracket_ (waitQSem slots) (signalQSem slots) . CE.try $
+          runStateT (runWriterT (runExceptT (runReaderT action config))) st
+        putMVar var result
+      return var
+
+    collect (Left e) = liftIO $ CE.throwIO (e :: CE.SomeException)
+    collect (Right ((Left err, msgs), _)) = tell msgs >> throwError err
+    collect (Right ((Right x, msgs), _)) = tell msgs >> return x
+
 -- | Execute a system call and return a function of the STDOUT
 runCommandWith ::
      MT.Text -- function making the call (used only in debugging messages on error)
@@ -43,6 +43,9 @@ module Morloc.Namespace
   , MorlocError(..)
   -- ** Configuration
   , Config(..)
+  , WireFormat(..)
+  , NexusBackend(..)
+  , BuildProfile(..)
   -- ** Morloc monad
   , MorlocMonad
   , MorlocState(..)
@@ -269,9 +272,54 @@ data Config =
     -- ^ path to R interpreter
     , configLangPerl :: !Path
     -- ^ path to perl interpreter
+    , configWireFormat :: !WireFormat
+    -- ^ encoding used for data passed between pools
+    , configPoolDaemons :: !Bool
+    -- ^ run pools as daemons that live as long as the nexus call
+    , configPoolThreads :: !Int
+    -- ^ maximum number of foreign calls a C++ manifold runs at once
+    , configNexus :: !NexusBackend
+    -- ^ the kind of executable generated for the user interface
+    , configResultCache :: !Int
+    -- ^ maximum size in megabytes of the on-disk cache of pool results, 0 turns it off
+    , configProfile :: !(Maybe Path)
+    -- ^ run times recorded by a generated program, used to choose between instances
+    , configBuildProfile :: !BuildProfile
+    -- ^ how compiled pools are optimized
+    , configTrainCommand :: !(Maybe Text)
+    -- ^ nexus arguments of the training run of a profile-guided build
     }
   deriving (Show, Ord, Eq)
 
+-- | The encoding used for serialized data passed between pools. Data sent to
+-- and returned from the nexus is always JSON.
+data WireFormat
+  = JsonWire
+  -- ^ JSON text, readable by every pool and by the nexus
+  | BinaryWire
+  -- ^ schema-driven, length-prefixed binary with little-endian numerics
+  deriving (Show, Ord, Eq)
+
+-- | The executable that dispatches user commands to the pools
+data NexusBackend
+  = PerlNexus
+  -- ^ a Perl script that runs each pool as a subprocess
+  | CppNexus
+  -- ^ a compiled C++ program that executes directly into the pool
+  deriving (Show, Ord, Eq)
+
+-- | The optimization settings of compiled pools
+data BuildProfile
+  = DebugBuild
+  -- ^ no optimization, with debugging symbols
+  | ReleaseBuild
+  -- ^ optimized with link-time optimization
+  | NativeBuild
+  -- ^ as release, but also tuned to the instruction set of the build machine
+  | PgoBuild
+  -- ^ as release, then rebuilt using the profile of a training run
+  deriving (Show, Ord, Eq)
+
 
 -- ================ T Y P E C H E C K I N G  =================================
 
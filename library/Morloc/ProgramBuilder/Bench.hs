@@ -0,0 +1,268 @@
+{-|
+Module      : Morloc.ProgramBuilder.Bench
+Description : Time the exported commands of a built program
+Copyright   : (c) Zebulun Arendsee, 2021
+License     : GPL-3
+Maintainer  : zbwrnz@gmail.com
+Stability   : experimental
+
+A benchmark runs the nexus of a built program many times for each of a list
+of calls. A call is either nexus arguments given by the user, or an exported
+command with arguments generated from its general type. The runs are made by
+a small C++ program, compiled once into the morloc temporary directory, that
+forks the nexus, discards its output and waits for it. It reports the wall
+time of each run, the peak resident set size of the largest process the run
+waited for, which includes pools that were not started as daemons, and the
+wall time of all timed runs end to end.
+
+For each call the latency percentiles, the throughput of back to back runs
+and the peak resident set size are printed and written to a JSON file. The
+throughput is the number of timed runs divided by their end to end time, so
+it includes the time between runs that the latencies leave out.
+-}
+module Morloc.ProgramBuilder.Bench
+  ( BenchPlan(..)
+  , bench
+  ) where
+
+import Morloc.Namespace
+import Morloc.Data.Doc
+import Morloc.Quasi
+import Morloc.Pretty (prettyType)
+import Data.Aeson ((.=))
+import Data.Version (showVersion)
+import Paths_morloc (version)
+import qualified Data.Aeson as JSON
+import qualified Data.ByteString.Lazy as BL
+import qualified Morloc.Data.Text as MT
+import qualified Morloc.Monad as MM
+import qualified System.Directory as SD
+import qualified System.Exit as SE
+import qualified System.Process as SP
+
+data BenchPlan = BenchPlan
+  { planCalls :: [[MT.Text]]
+  -- ^ nexus arguments given by the user, the first is the command
+  , planCommands :: [EVar]
+  -- ^ exported commands to run with generated arguments
+  , planSize :: Int
+  -- ^ the length of generated lists and strings
+  , planRuns :: Int
+  -- ^ timed runs of each call
+  , planWarmup :: Int
+  -- ^ untimed runs made before them
+  , planJson :: Path
+  -- ^ where the results are written
+  }
+
+-- | Measurements of one call
+data Timing = Timing
+  { timingCall :: [MT.Text]
+  , timingTimes :: [Double]
+  -- ^ wall time of each run in nanoseconds, ascending
+  , timingRss :: Integer
+  -- ^ the largest peak resident set size of any run in kilobytes
+  , timingTotal :: Double
+  -- ^ wall time of all timed runs, from the start of the first to the end of
+  -- the last, in nanoseconds
+  }
+
+-- | Run the calls of a plan against a built nexus. The exported commands are
+-- given with their general types. Without user calls or chosen commands,
+-- every exported command is run.
+bench :: BenchPlan -> Path -> [(EVar, Type)] -> MorlocMonad ()
+bench plan nexus exports = do
+  let chosen = if null (planCalls plan) && null (planCommands plan)
+                 then map fst exports
+                 else planCommands plan
+  generated <- mapM (generateCall (planSize plan) exports) chosen
+  runner <- buildRunner
+  timings <- mapM (time runner) (planCalls plan ++ generated)
+  mapM_ report timings
+  liftIO . BL.writeFile (MT.unpack (unPath (planJson plan))) . JSON.encode $ JSON.object
+    [ "morloc" .= showVersion version
+    , "runs" .= planRuns plan
+    , "warmup" .= planWarmup plan
+    , "calls" .= map timingJson timings
+    ]
+  MM.say $ "wrote" <+> pretty (unPath (planJson plan))
+  where
+    time :: FilePath -> [MT.Text] -> MorlocMonad Timing
+    time runner call = do
+      let args = [show (planWarmup plan), show (planRuns plan), MT.unpack (unPath nexus)] ++ map MT.unpack call
+      (code, out, err) <- liftIO $ SP.readProcessWithExitCode runner args ""
+      case (code, mapM (mapM readMay . words) (lines out)) of
+        -- a line for each run, then one for the whole batch
+        (SE.ExitSuccess, Just rows)
+          | runs@(_:_) <- [(t, rss) | [t, rss] <- rows]
+          , [total] <- [x | [x] <- rows] -> return $ Timing
+            { timingCall = call
+            , timingTimes = sort (map fst runs)
+            , timingRss = maximum (map (round . snd) runs)
+            , timingTotal = total
+            }
+        _ -> MM.throwError . OtherError $
+          "Failed to benchmark '" <> MT.unwords call <> "': " <> MT.pack err
+
+-- | Arguments of an exported command, as the JSON the nexus reads
+generateCall :: Int -> [(EVar, Type)] -> EVar -> MorlocMonad [MT.Text]
+generateCall n exports name = case lookup name exports of
+  Nothing -> MM.throwError . OtherError $ "No exported command named '" <> unEVar name <> "'"
+  (Just t) -> case mapM (sample n) (fst (decompose t)) of
+    (Right args) -> return (unEVar name : args)
+    (Left u) -> MM.throwError . OtherError . render $
+      "Cannot generate arguments of type" <+> prettyType u <+> "for" <+> pretty (unEVar name)
+      <> ", give them with --call"
+
+-- | A value of a general type, with lists and strings of length @n@. Fails
+-- with the first part of the type that has no sample, such as a generic
+-- type variable.
+sample :: Int -> Type -> Either Type MT.Text
+sample n t@(VarT (TV _ v)) = case v of
+  "Unit" -> Right "null"
+  "Bool" -> Right "true"
+  "Int" -> Right (MT.show' n)
+  "Num" -> Right (MT.show' n <> ".5")
+  "Real" -> Right (MT.show' n <> ".5")
+  "Str" -> Right ("\"" <> MT.replicate n "x" <> "\"")
+  _ -> Left t
+sample n (ArrT (TV _ "List") [t]) = array <$> replicateM n (sample n t)
+sample n t@(ArrT (TV _ v) ts)
+  | MT.isPrefixOf "Tuple" v = array <$> mapM (sample n) ts
+  | otherwise = Left t
+sample n (NamT _ _ _ entries) = do
+  values <- mapM (sample n . snd) entries
+  return $ "{" <> MT.intercalate "," [MT.show' k <> ":" <> x | ((k, _), x) <- zip entries values] <> "}"
+sample _ t = Left t
+
+array :: [MT.Text] -> MT.Text
+array xs = "[" <> MT.intercalate "," xs <> "]"
+
+report :: Timing -> MorlocMonad ()
+report t = MM.say $ pretty (MT.unwords (timingCall t)) <> ":"
+  <+> "p50" <+> ms (percentile 0.5 ts)
+  <+> "p90" <+> ms (percentile 0.9 ts)
+  <+> "p99" <+> ms (percentile 0.99 ts) <> ","
+  <+> viaShow (throughput t) <+> "calls/s,"
+  <+> "peak RSS" <+> viaShow (timingRss t) <+> "kB"
+  where
+    ts = timingTimes t
+    ms x = viaShow (fromIntegral (round (x / 1e4) :: Integer) / 100 :: Double) <+> "ms"
+
+timingJson :: Timing -> JSON.Value
+timingJson t = JSON.object
+  [ "call" .= timingCall t
+  , "latency_ns" .= JSON.object
+    [ "min" .= head ts
+    , "p50" .= percentile 0.5 ts
+    , "p90" .= percentile 0.9 ts
+    , "p99" .= percentile 0.99 ts
+    , "max" .= last ts
+    , "mean" .= mean ts
+    ]
+  , "throughput_per_s" .= throughput t
+  , "peak_rss_kb" .= timingRss t
+  ]
+  where
+    ts = timingTimes t
+
+-- | The nearest-rank percentile of ascending values
+percentile :: Double -> [Double] -> Double
+percentile p xs = xs !! max 0 (ceiling (p * fromIntegral (length xs)) - 1)
+
+mean :: [Double] -> Double
+mean xs = sum xs / fromIntegral (length xs)
+
+-- | Calls per second when run one after the other, measured end to end
+throughput :: Timing -> Double
+throughput t = 1e9 * fromIntegral (length (timingTimes t)) / timingTotal t
+
+-- | Compile the program that runs and measures the nexus, unless it exists
+buildRunner :: MorlocMonad FilePath
+buildRunner = do
+  tmpdir <- MM.asks (MT.unpack . unPath . configTmpDir)
+  let dir = tmpdir <> "/bench"
+      src = dir <> "/run.cpp"
+      exe = dir <> "/run"
+      code = render runnerCode
+  built <- liftIO $ (&&) <$> SD.doesFileExist exe <*> ((== Just code) <$> readIfExists src)
+  unless built $ do
+    liftIO $ do
+      SD.createDirectoryIfMissing True dir
+      MT.writeFile src code
+    MM.runCommand "Bench" . MT.pack $ "g++ --std=c++11 -O2 -o " <> exe <> " " <> src
+  return exe
+  where
+    readIfExists :: FilePath -> IO (Maybe MT.Text)
+    readIfExists path = do
+      exists <- SD.doesFileExist path
+      if exists then Just <$> MT.readFile path else return Nothing
+
+runnerCode :: MDoc
+runnerCode = [idoc|// Run a command repeatedly. For every run after the warmup runs, print its
+// wall time in nanoseconds and the peak resident set size in kilobytes of the
+// largest process it waited for. Then print the wall time in nanoseconds of
+// all runs after the warmup, from the start of the first to the end of the
+// last.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char * argv[])
+{
+    if(argc < 4){
+        fprintf(stderr, "usage: %s WARMUP RUNS COMMAND [ARG ...]\n", argv[0]);
+        return 2;
+    }
+    int warmup = atoi(argv[1]);
+    int runs = atoi(argv[2]);
+    char ** cmd = argv + 3;
+
+    auto first = std::chrono::steady_clock::now();
+    for(int i = 0; i < warmup + runs; i++){
+        auto start = std::chrono::steady_clock::now();
+        if(i == warmup){
+            first = start;
+        }
+        pid_t pid = fork();
+        if(pid < 0){
+            perror("fork");
+            return 1;
+        }
+        if(pid == 0){
+            int devnull = open("/dev/null", O_WRONLY);
+            dup2(devnull, STDOUT_FILENO);
+            execvp(cmd[0], cmd);
+            perror(cmd[0]);
+            _exit(127);
+        }
+        int status;
+        struct rusage usage;
+        if(wait4(pid, &status, 0, &usage) < 0){
+            perror("wait4");
+            return 1;
+        }
+        auto stop = std::chrono::steady_clock::now();
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            fprintf(stderr, "run %d exited with an error\n", i + 1);
+            return 1;
+        }
+        if(i >= warmup){
+            long rss = usage.ru_maxrss;
+#ifdef __APPLE__
+            rss /= 1024; // reported in bytes rather than kilobytes
+#endif
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+            printf("%lld %ld\n", ns, rss);
+        }
+    }
+    auto last = std::chrono::steady_clock::now();
+    printf("%lld\n", (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(last - first).count());
+    return 0;
+}
+|]
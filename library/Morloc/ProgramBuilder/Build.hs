@@ -5,49 +5,229 @@ Copyright   : (c) Zebulun Arendsee, 2021
 License     : GPL-3
 Maintainer  : zbwrnz@gmail.com
 Stability   : experimental
+
+Compiled pools are built with the flags of the configured build profile. A
+profile-guided build compiles instrumented pools, runs the nexus once with the
+training arguments, and then recompiles the pools with the recorded profile.
+
+Compiled executables are cached under the morloc home directory. The key of
+an executable is a hash of the compiler version, the full compiler command and
+the contents of the source and every header it includes, as listed by the
+compiler. A build whose key is cached copies the executable instead of
+compiling. Profile-guided builds are not cached, since they also depend on the
+training run.
+
+C++ pools include the morloc runtime headers rather than a pasted copy of
+them. The headers are installed under the morloc home and the non-template
+part of the runtime, the serializers, foreign calls, result cache and daemon
+loop, is compiled once per compiler and build profile into a static library
+that pools link against. A pool translation unit holds only the code generated
+for it and the headers of its modules.
+
+The pools and the nexus are built in parallel, as are the objects of the
+runtime library. Each pool is still compiled as one translation unit, so a
+program with a single large pool gains little from the parallel build.
 -}
 module Morloc.ProgramBuilder.Build
   ( buildProgram
+  , nexusExecutable
   ) where
 
 import Morloc.Namespace
+import Morloc.Data.Doc (pretty, render, (<+>))
 import qualified Morloc.Data.Text as MT
-import qualified Morloc.Data.Doc as MD
+import qualified Data.ByteString as BS
 import qualified Morloc.Language as ML
 import qualified Morloc.Monad as MM
+import qualified Morloc.System as MS
+import qualified Morloc.CodeGenerator.Grammars.Translator.Source.CppInternals as Src
 import qualified Control.Monad.State as CMS
 
 import qualified System.Directory as SD
+import System.IO.Temp (createTempDirectory)
 
 buildProgram :: (Script, [Script]) -> MorlocMonad ()
 buildProgram (nexus, pools) = do
-  mapM_ (build Nothing) pools
   outfile <- CMS.gets stateOutfile
-  build outfile nexus
+  profile <- MM.asks configBuildProfile
+  case profile of
+    PgoBuild -> do
+      train <- MM.asks configTrainCommand >>= maybe
+        (MM.throwError . OtherError $ "A 'pgo' build needs the nexus arguments of a training run, given with --train")
+        return
+      dir <- pgoDir
+      -- daemon children write their profile with __gcov_dump, which the
+      -- runtime library only references weakly
+      let generate = ["-fprofile-generate", "-fprofile-update=atomic", "-fprofile-dir=" <> dir, "-Wl,-u,__gcov_dump"]
+      buildAll $ build [] outfile nexus : map (build generate Nothing) pools
+      exe <- nexusExecutable nexus
+      MM.runCommand "PgoTrain" $ unPath exe <> " " <> train
+      buildAll [ build ["-fprofile-use", "-fprofile-correction", "-fprofile-dir=" <> dir] Nothing p
+               | p <- pools, compiled (scriptLang p) ]
+      liftIO $ SD.removePathForcibly (MT.unpack dir)
+    _ -> buildAll $ build [] outfile nexus : map (build [] Nothing) pools
+
+buildAll :: [MorlocMonad ()] -> MorlocMonad ()
+buildAll = void . MM.concurrently
 
-build :: Maybe Path -> Script -> MorlocMonad ()
-build filename s =
-  case (scriptLang s, exeName) of
+build :: [MT.Text] -> Maybe Path -> Script -> MorlocMonad ()
+build flags filename s =
+  case (scriptLang s, exeName filename s) of
     (Python3Lang, name) -> liftIO $ writeInterpreted name s
     (RLang, name) -> liftIO $ writeInterpreted name s
     (PerlLang, name) -> liftIO $ writeInterpreted name s
-    (CLang, name) -> gccBuild name s "gcc"
-    (CppLang, name) -> gccBuild name s "g++ --std=c++11" -- TODO: I need more rigorous build handling
-  where
-    exeName = Path $ makeExecutableName filename (scriptLang s) (MT.pack (scriptBase s))
+    (CLang, name) -> gccBuild name s flags "gcc"
+    (CppLang, name) -> gccBuild name s flags "g++ --std=c++11 -pthread"
+
+exeName :: Maybe Path -> Script -> Path
+exeName filename s = Path $ makeExecutableName filename (scriptLang s) (MT.pack (scriptBase s))
 
 makeExecutableName :: Maybe Path -> Lang -> MT.Text -> MT.Text
 makeExecutableName Nothing lang base = ML.makeExecutableName lang base
 makeExecutableName (Just (Path filename)) _ _ = filename
 
--- | Compile a C program
-gccBuild :: Path -> Script -> MT.Text -> MorlocMonad ()
-gccBuild (Path exe) s cmd = do
+compiled :: Lang -> Bool
+compiled lang = lang == CLang || lang == CppLang
+
+-- | The path that runs a built nexus. The nexus is written to the working
+-- directory unless a path was given.
+nexusExecutable :: Script -> MorlocMonad Path
+nexusExecutable nexus = do
+  outfile <- CMS.gets stateOutfile
+  return $ case exeName outfile nexus of
+    (Path exe) | MT.isInfixOf "/" exe -> Path exe
+               | otherwise -> Path ("./" <> exe)
+
+-- | Create the directory where the instrumented pools write their profiles.
+-- Each build has its own, so concurrent builds of other programs neither mix
+-- their counts nor delete them.
+pgoDir :: MorlocMonad MT.Text
+pgoDir = do
+  tmpdir <- MM.asks (MT.unpack . unPath . configTmpDir)
+  liftIO $ do
+    SD.createDirectoryIfMissing True tmpdir
+    MT.pack <$> createTempDirectory tmpdir "pgo"
+
+-- | Compiler flags of each build profile
+profileFlags :: BuildProfile -> [MT.Text]
+profileFlags DebugBuild = ["-O0", "-g"]
+profileFlags ReleaseBuild = ["-O2", "-flto=auto"]
+profileFlags NativeBuild = ["-O3", "-march=native", "-flto=auto"]
+profileFlags PgoBuild = ["-O2", "-flto=auto"]
+
+-- | Compile a C program, or copy it from the build cache
+gccBuild :: Path -> Script -> [MT.Text] -> MT.Text -> MorlocMonad ()
+gccBuild (Path exe) s flags cmd = do
+  profile <- MM.asks configBuildProfile
   let src = ML.makeSourceName (scriptLang s) (MT.pack (scriptBase s))
-  let inc = ["-I" <> unPath i | i <- scriptInclude s]
-  liftIO $ MT.writeFile (MT.unpack src) (unCode (scriptCode s))
-  MM.runCommand "GccBuild" $
-    MT.unwords ([cmd, "-o", exe, src] ++ scriptCompilerFlags s ++ inc)
+      inc = ["-I" <> unPath i | i <- scriptInclude s]
+      code = unCode (scriptCode s)
+  liftIO $ MT.writeFile (MT.unpack src) code
+  version <- MM.runCommandWith "GccBuild" id (cmd <> " --version")
+  -- a pool that includes a runtime header links against the runtime library
+  (runtimeInc, runtimeLib) <-
+    if any (flip MT.isInfixOf code . fst) Src.runtimeHeaders
+      then cppRuntime cmd version (profileFlags profile)
+      else return ([], [])
+  let options = profileFlags profile ++ flags ++ scriptCompilerFlags s ++ runtimeInc ++ inc
+      command = MT.unwords $
+        [cmd] ++ profileFlags profile ++ flags ++ ["-o", exe, src]
+        ++ runtimeLib ++ scriptCompilerFlags s ++ runtimeInc ++ inc
+  if not (null flags)
+    then MM.runCommand "GccBuild" command
+    else do
+      deps <- MM.runCommandWith "GccBuild" dependencies (MT.unwords ([cmd, "-MM", src] ++ options))
+      contents <- liftIO $ mapM (BS.readFile . MT.unpack) deps
+      dir <- buildCacheDir
+      let key = MT.fnv1a . MT.unlines $
+            [version, command] ++ concat [[d, MT.fnv1aBytes c] | (d, c) <- zip deps contents]
+          cached = MT.unpack (unPath (MS.combine dir (Path key)))
+      hit <- liftIO $ SD.doesFileExist cached
+      verbosity <- CMS.gets stateVerbosity
+      if hit
+        then do
+          when (verbosity > 0) $ MM.say ("reusing cached build of" <+> pretty exe)
+          liftIO $ SD.copyFile cached (MT.unpack exe)
+        else do
+          MM.runCommand "GccBuild" command
+          -- copyFile writes a temporary file and renames it, so concurrent
+          -- builds never see a partial entry
+          liftIO $ do
+            SD.createDirectoryIfMissing True (MT.unpack (unPath dir))
+            SD.copyFile (MT.unpack exe) cached
+
+-- | Install the C++ runtime headers under the morloc home and build the
+-- runtime library for the given compiler and flags, unless this was already
+-- done. Libraries are named after a hash of the compiler, flags and runtime
+-- code, so each build profile has its own. Each header is compiled to its own
+-- object, in parallel, in a scratch directory of this build, so concurrent
+-- builds share only the finished files. Returns the include flag and the
+-- library.
+cppRuntime :: MT.Text -> MT.Text -> [MT.Text] -> MorlocMonad ([MT.Text], [MT.Text])
+cppRuntime cmd version options = do
+  home <- MM.asks configHome
+  tmpdir <- MM.asks configTmpDir
+  let includeDir = MS.combine home (Path "include")
+      headers = [(name, render code) | (name, code) <- Src.runtimeHeaders]
+      key = MT.fnv1a (MT.unlines ([version, cmd, MT.unwords options] ++ map snd headers))
+      lib = MS.combine home (Path ("lib/libmorloc-" <> key <> ".a"))
+      -- archives of LTO objects need the index that the gcc plugin writes
+      archiver = if any (MT.isPrefixOf "-flto") options then "gcc-ar" else "ar"
+  work <- liftIO $ do
+    SD.createDirectoryIfMissing True (MT.unpack (unPath tmpdir))
+    Path . MT.pack <$> createTempDirectory (MT.unpack (unPath tmpdir)) (MT.unpack ("runtime-" <> key))
+  let inWork = unPath . MS.combine work . Path
+      archive = inWork "libmorloc.a"
+  forM_ (zip [0 :: Int ..] headers) $ \(i, (name, code)) -> do
+    installed <- liftIO $ readIfExists (MS.combine includeDir (Path name))
+    when (installed /= Just code) . liftIO $ do
+      let tmp = Path (inWork ("header-" <> MT.show' i))
+      MT.writeFile (MT.unpack (unPath tmp)) code
+      copyInto tmp (MS.combine includeDir (Path name))
+  built <- liftIO $ MS.fileExists lib
+  unless built $ do
+    objs <- MM.concurrently
+      [ do
+          -- the headers before this one are included without their
+          -- implementation, their include guards keep it out
+          let src = inWork ("runtime-" <> MT.show' i <> ".cpp")
+              obj = inWork ("runtime-" <> MT.show' i <> ".o")
+          liftIO . MT.writeFile (MT.unpack src) . MT.unlines $
+            [include h | (h, _) <- take i headers]
+            ++ ["#define MORLOC_RUNTIME_IMPLEMENTATION", include name]
+          MM.runCommand "GccBuild" . MT.unwords $
+            [cmd] ++ options ++ ["-I" <> unPath includeDir, "-c", src, "-o", obj]
+          return obj
+      | (i, (name, _)) <- zip [0 ..] headers ]
+    MM.runCommand "GccBuild" . MT.unwords $ [archiver, "rcs", archive] ++ objs
+    liftIO $ copyInto (Path archive) lib
+  liftIO $ SD.removePathForcibly (MT.unpack (unPath work))
+  return (["-I" <> unPath includeDir], [unPath lib])
+  where
+    include :: MT.Text -> MT.Text
+    include name = "#include \"" <> name <> "\""
+
+    readIfExists :: Path -> IO (Maybe MT.Text)
+    readIfExists path = do
+      exists <- MS.fileExists path
+      if exists
+        then Just <$> MT.readFile (MT.unpack (unPath path))
+        else return Nothing
+
+    -- copyFile renames a temporary copy into place, so a concurrent build
+    -- never reads a partial file
+    copyInto :: Path -> Path -> IO ()
+    copyInto from to = do
+      SD.createDirectoryIfMissing True (MT.unpack (unPath (MS.takeDirectory to)))
+      SD.copyFile (MT.unpack (unPath from)) (MT.unpack (unPath to))
+
+-- | The files a compilation reads, parsed from the make rule that @-MM@
+-- prints. System headers are left out, the compiler version stands for them.
+dependencies :: MT.Text -> [MT.Text]
+dependencies = filter (/= "\\") . MT.words . MT.drop 1 . MT.dropWhile (/= ':')
+
+buildCacheDir :: MorlocMonad Path
+buildCacheDir = MM.asks (\c -> MS.combine (configHome c) (Path "build-cache"))
 
 -- | Build an interpreted script.
 writeInterpreted :: Path -> Script -> IO ()
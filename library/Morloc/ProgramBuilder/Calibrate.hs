@@ -0,0 +1,222 @@
+{-|
+Module      : Morloc.ProgramBuilder.Calibrate
+Description : Measure the cost model of the local machine
+Copyright   : (c) Zebulun Arendsee, 2021
+License     : GPL-3
+Maintainer  : zbwrnz@gmail.com
+Stability   : experimental
+
+For each installed pool language, a small program is written to the morloc
+temporary directory and run. It reports the cost of a function call and of
+serializing one byte. The cost of starting a process is timed from outside
+by running the same program with the argument @startup@, which makes it exit
+at once. A language whose interpreter or compiler is missing is skipped.
+-}
+module Morloc.ProgramBuilder.Calibrate
+  ( calibrate
+  ) where
+
+import Morloc.Namespace
+import Morloc.CostModel
+import Morloc.Data.Doc
+import Morloc.Quasi
+import Control.Exception (SomeException, try)
+import GHC.Clock (getMonotonicTimeNSec)
+import qualified Data.Map as Map
+import qualified Morloc.Data.Text as MT
+import qualified Morloc.Language as ML
+import qualified Morloc.Monad as MM
+import qualified Morloc.CodeGenerator.Grammars.Translator.Source.CppInternals as Src
+import qualified System.Directory as SD
+import qualified System.Exit as SE
+import qualified System.Process as SP
+
+-- | Measure every installed language and write the cost profile that the
+-- realize step reads
+calibrate :: MorlocMonad CostModel
+calibrate = do
+  config <- MM.ask
+  let dir = MT.unpack (unPath (configTmpDir config)) <> "/calibrate"
+  liftIO $ SD.createDirectoryIfMissing True dir
+  costs <- mapM measure
+    [ (CppLang, cppSetup dir)
+    , (Python3Lang, scriptSetup dir "calibrate.py" pyCalibrate (MT.unpack (unPath (configLangPython3 config))))
+    , (RLang, scriptSetup dir "calibrate.R" rCalibrate (MT.unpack (unPath (configLangR config))))
+    ]
+  let model = emptyCostModel { costLangs = Map.fromList (catMaybes costs) }
+  path <- writeCostModel model
+  MM.say $ "wrote" <+> pretty (unPath path)
+  return model
+
+-- | Prepare the calibration program of a language and return the command
+-- that runs it
+type Setup = IO (Either String (String, [String]))
+
+measure :: (Lang, Setup) -> MorlocMonad (Maybe (Lang, LangCost))
+measure (lang, setup) = do
+  result <- liftIO . tryIO $ setup >>= either (return . Left) (uncurry costs)
+  let name = pretty (ML.showLangName lang)
+  case either (Left . show) id result of
+    (Left err) -> do
+      MM.say $ "skipping" <+> name <> ":" <+> pretty err
+      return Nothing
+    (Right cost) -> do
+      MM.say $ name <> ":"
+        <+> "startup" <+> viaShow (costStartup cost) <+> "ns,"
+        <+> "call" <+> viaShow (costCall cost) <+> "ns,"
+        <+> "byte" <+> viaShow (costByte cost) <+> "ns"
+      return $ Just (lang, cost)
+  where
+    tryIO :: IO a -> IO (Either SomeException a)
+    tryIO = try
+
+    costs :: String -> [String] -> IO (Either String LangCost)
+    costs cmd args = do
+      out <- run cmd args
+      case mapM readMay . words <$> out of
+        (Left err) -> return (Left err)
+        (Right (Just [call, byte])) -> do
+          startups <- mapM (const (timed (run cmd (args ++ ["startup"])))) [1 .. startupRuns]
+          return . Right $ LangCost (minimum startups) call byte
+        (Right _) -> return . Left $ "unexpected output from " <> cmd
+
+-- | The best of several runs is the startup cost, the others are slowed by
+-- whatever else the machine is doing
+startupRuns :: Int
+startupRuns = 5
+
+run :: String -> [String] -> IO (Either String String)
+run cmd args = do
+  (code, out, err) <- SP.readProcessWithExitCode cmd args ""
+  return $ case code of
+    SE.ExitSuccess -> Right out
+    _ -> Left err
+
+-- | The wall time of an action in nanoseconds
+timed :: IO a -> IO Double
+timed action = do
+  start <- getMonotonicTimeNSec
+  _ <- action
+  stop <- getMonotonicTimeNSec
+  return $ fromIntegral (stop - start)
+
+scriptSetup :: FilePath -> FilePath -> MDoc -> String -> Setup
+scriptSetup dir name code interpreter = do
+  let script = dir <> "/" <> name
+  MT.writeFile script (render code)
+  return $ Right (interpreter, [script])
+
+-- | The C++ program is compiled against the serializers that every C++ pool
+-- includes
+cppSetup :: FilePath -> Setup
+cppSetup dir = do
+  let exe = dir <> "/calibrate-cpp.out"
+      src = dir <> "/calibrate.cpp"
+  MT.writeFile (dir <> "/serial.hpp") (render Src.serializationHandling)
+  MT.writeFile src (render cppCalibrate)
+  result <- run "g++" ["--std=c++11", "-O2", "-I" <> dir, "-o", exe, src]
+  return $ fmap (const (exe, [])) result
+
+cppCalibrate :: MDoc
+cppCalibrate = [idoc|// Measure the cost of a function call and of serializing one byte in a C++
+// pool. With the argument "startup" the program exits at once, so its run
+// time is the cost of starting a pool.
+
+#include <chrono>
+#define MORLOC_RUNTIME_IMPLEMENTATION
+#include "serial.hpp"
+
+double identity(double x){
+    return x;
+}
+
+int main(int argc, char * argv[])
+{
+    if(argc > 1 && std::string(argv[1]) == "startup"){
+        return 0;
+    }
+
+    // call through a volatile pointer so the call is not inlined
+    double (* volatile f)(double) = identity;
+    const size_t calls = 100000000;
+    double total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < calls; i++){
+        total += f(i);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double call = std::chrono::duration<double, std::nano>(stop - start).count() / calls;
+
+    std::vector<double> xs(1000000);
+    for(size_t i = 0; i < xs.size(); i++){
+        xs[i] = i + 0.5;
+    }
+    start = std::chrono::steady_clock::now();
+    std::string json = serialize(xs, xs);
+    std::vector<double> ys = deserialize(json, xs);
+    stop = std::chrono::steady_clock::now();
+    double byte = std::chrono::duration<double, std::nano>(stop - start).count() / json.size();
+
+    if(ys.size() != xs.size() || total < 0){
+        std::cerr << "Serialization round trip failed" << std::endl;
+        return 1;
+    }
+    std::cout << call << " " << byte << std::endl;
+    return 0;
+}
+|]
+
+pyCalibrate :: MDoc
+pyCalibrate = [idoc|# Measure the cost of a function call and of serializing one byte in a Python
+# pool. With the argument "startup" the script exits at once, so its run time
+# is the cost of starting a pool.
+
+import json
+import sys
+import time
+
+if sys.argv[1:] == ["startup"]:
+    sys.exit(0)
+
+def identity(x):
+    return x
+
+calls = 1000000
+start = time.perf_counter()
+for i in range(calls):
+    identity(i)
+call = (time.perf_counter() - start) * 1e9 / calls
+
+xs = [i + 0.5 for i in range(1000000)]
+start = time.perf_counter()
+data = json.dumps(xs)
+json.loads(data)
+byte = (time.perf_counter() - start) * 1e9 / len(data)
+
+print(call, byte)
+|]
+
+rCalibrate :: MDoc
+rCalibrate = [idoc|# Measure the cost of a function call and of serializing one byte in an R
+# pool. With the argument "startup" the script exits at once, so its run time
+# is the cost of starting a pool.
+
+if (identical(commandArgs(trailingOnly = TRUE), "startup")) {
+  quit(status = 0)
+}
+
+f <- function(x) x
+
+calls <- 1000000
+start <- proc.time()[["elapsed"]]
+for (i in seq_len(calls)) f(i)
+call <- (proc.time()[["elapsed"]] - start) * 1e9 / calls
+
+xs <- seq_len(1000000) + 0.5
+start <- proc.time()[["elapsed"]]
+data <- jsonlite::toJSON(xs, digits = NA)
+ys <- jsonlite::fromJSON(data)
+byte <- (proc.time()[["elapsed"]] - start) * 1e9 / nchar(data)
+
+cat(call, byte, "\n")
+|]
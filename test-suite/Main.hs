@@ -4,6 +4,7 @@ import qualified System.Directory as SD
 import PropertyTests (propertyTests)
 import UnitTypeTests
 import GoldenMakefileTests (goldenMakefileTest)
+import SerialBenchmarkTests (serialBenchmarkTests)
 
 main = do
   wd <- SD.getCurrentDirectory >>= SD.makeAbsolute
@@ -18,6 +19,8 @@ main = do
       , propertyTests
       , jsontype2jsonTests
       , recordAccessTests
+      , costModelTests
+      , serialBenchmarkTests wd
 
       , golden "import-1" "import-1"
 
@@ -60,6 +63,29 @@ main = do
       , golden "interop-1-r" "interop-1-r"
       , golden "interop-2" "interop-2"
 
+      , golden "wire-binary-py" "wire-binary-py"
+      , golden "wire-binary-r" "wire-binary-r"
+
+      , golden "pool-daemons-py" "pool-daemons-py"
+      , golden "pool-daemons-r" "pool-daemons-r"
+
+      , golden "nexus-cpp" "nexus-cpp"
+      , golden "nexus-batch" "nexus-batch"
+      , golden "nexus-batch-utf8" "nexus-batch-utf8"
+      , golden "result-cache" "result-cache"
+      , golden "elide-roundtrip" "elide-roundtrip"
+      , golden "let-optimize-merge" "let-optimize-merge"
+      , golden "let-optimize-distinct" "let-optimize-distinct"
+      , golden "profile-guided" "profile-guided"
+      , golden "build-profile-pgo" "build-profile-pgo"
+      , golden "trace-events" "trace-events"
+      , golden "bench-json" "bench-json"
+
+      , golden "foreign-call-large" "foreign-call-large"
+      , golden "foreign-map" "foreign-map"
+      , golden "cpp-direct-map" "cpp-direct-map"
+      , golden "concurrent-calls" "concurrent-calls"
+
       , golden "manifold-form-0" "manifold-form-0"
       , golden "manifold-form-0x" "manifold-form-0x"
       , golden "manifold-form-1" "manifold-form-1"
@@ -0,0 +1,64 @@
+module SerialBenchmarkTests
+  ( serialBenchmarkTests
+  ) where
+
+import qualified Morloc.CodeGenerator.Grammars.Translator.Source.CppInternals as Src
+import qualified Morloc.CodeGenerator.Grammars.Translator.Cpp as Cpp
+import qualified Morloc.Data.Doc as Doc
+import qualified Data.Text.IO as TIO
+import qualified System.Exit as SE
+import qualified System.Process as SP
+import System.Environment (lookupEnv)
+import System.IO.Temp (withSystemTempDirectory)
+import Test.Tasty
+import Test.Tasty.HUnit
+
+-- | Tests of the C++ serializers in serial.hpp.
+serialBenchmarkTests :: FilePath -> TestTree
+serialBenchmarkTests wd = testGroup "C++ serialization"
+  [ roundTripTests wd
+  , integerParseTests wd
+  ]
+
+-- | Run the C++ serialization throughput suite of the benchmarks at small
+-- sizes. It fails if a payload does not survive a round trip. Wall times vary
+-- too much between machines to fail a test by default, so they are compared
+-- to the stored baseline only when MORLOC_TEST_TIMING is set. The tolerance is
+-- then wider than that of the benchmarks, since the tests run on machines
+-- other than the one that measured the baseline.
+roundTripTests :: FilePath -> TestTree
+roundTripTests wd = testCase "C++ serialization round trips" $
+  withSystemTempDirectory "morloc-test-bench" $ \dir -> do
+    let exe = dir ++ "/serial-throughput"
+    TIO.writeFile (dir ++ "/serial.hpp") (Doc.render Src.serializationHandling)
+    TIO.writeFile (dir ++ "/record.hpp") (Doc.render Cpp.benchRecord)
+    SP.callProcess "g++"
+      ["--std=c++11", "-O2", "-I" ++ dir, "-o", exe, wd ++ "/bench/cpp/serial-throughput.cpp"]
+    timed <- lookupEnv "MORLOC_TEST_TIMING"
+    -- without timing, each payload is serialized and deserialized once
+    let timing = case timed of
+          Just _ ->
+            [ "--baseline", wd ++ "/bench/serial-baseline.txt"
+            , "--tolerance", "3"
+            , "--budget", "10000000"
+            ]
+          Nothing -> ["--budget", "1"]
+    (code, out, err) <- SP.readProcessWithExitCode exe
+      (timing ++ ["10", "1000", "100000"]) ""
+    case code of
+      SE.ExitSuccess -> return ()
+      _ -> assertFailure (out ++ err)
+
+-- | Check that the JSON integer parsers reject values that overflow their
+-- type and negative values for unsigned types.
+integerParseTests :: FilePath -> TestTree
+integerParseTests wd = testCase "C++ integer parsing bounds" $
+  withSystemTempDirectory "morloc-test-parse" $ \dir -> do
+    let exe = dir ++ "/integer-parse"
+    TIO.writeFile (dir ++ "/serial.hpp") (Doc.render Src.serializationHandling)
+    SP.callProcess "g++"
+      ["--std=c++11", "-I" ++ dir, "-o", exe, wd ++ "/test-suite/cpp/integer-parse.cpp"]
+    (code, out, err) <- SP.readProcessWithExitCode exe [] ""
+    case code of
+      SE.ExitSuccess -> return ()
+      _ -> assertFailure (out ++ err)
@@ -7,6 +7,7 @@ module UnitTypeTests
   , jsontype2jsonTests
   , packerTests
   , recordAccessTests
+  , costModelTests
   ) where
 
 import Morloc.Frontend.Namespace
@@ -19,6 +20,7 @@ import qualified Morloc.Data.DAG as MDD
 import Morloc.Frontend.Infer hiding(typecheck)
 import Morloc.Frontend.Desugar (desugar)
 import Morloc (typecheck)
+import Morloc.CostModel
 import qualified Morloc.Monad as MM
 import qualified Morloc.Frontend.PartialOrder as MP
 
@@ -58,6 +60,14 @@ run code = do
         , configLangPython3 = Path ""
         , configLangR = Path ""
         , configLangPerl = Path ""
+        , configWireFormat = JsonWire
+        , configPoolDaemons = False
+        , configPoolThreads = 1
+        , configNexus = PerlNexus
+        , configResultCache = 0
+        , configProfile = Nothing
+        , configBuildProfile = DebugBuild
+        , configTrainCommand = Nothing
         }
 
 assertTerminalType :: String -> T.Text -> [UnresolvedType] -> TestTree
@@ -350,6 +360,44 @@ jsontype2jsonTests =
   where
     jsontest msg t j = testEqual msg (Doc.render $ jsontype2json t) j
 
+costModelTests =
+  testGroup
+    "Test the costs of calls within and between languages"
+    [ testEqual "unmeasured costs are scaled to nanoseconds"
+        (interopCost emptyCostModel Python3Lang RLang)
+        (Just (1000000 * unmeasuredScale))
+    , testEqual "a measured call within a language"
+        (interopCost calibrated CppLang CppLang)
+        (Just 3)
+    , testEqual "a measured foreign call"
+        (interopCost calibrated CppLang Python3Lang)
+        (Just (20000000 + 100 + 1000 * (1 + 5)))
+    , testEqual "an unmeasured callee uses the scaled table"
+        (interopCost calibrated CppLang RLang)
+        (Just (1000000 * unmeasuredScale))
+    , testEqual "an unmeasured caller uses the scaled table"
+        (interopCost calibrated PerlLang CppLang)
+        (Just (100 * unmeasuredScale))
+    , testCase "measured and unmeasured foreign calls are comparable" $
+        assertBool "a measured Python call should cost less than an unmeasured R call"
+          (interopCost calibrated CppLang Python3Lang < interopCost calibrated CppLang RLang)
+    , testEqual "profiled run times are in nanoseconds"
+        (callCost profiled (Source (Name "foo") Python3Lang Nothing (EVar "foo")))
+        5000000
+    , testEqual "unprofiled functions cost nothing"
+        (callCost profiled (Source (Name "bar") Python3Lang Nothing (EVar "bar")))
+        0
+    ]
+  where
+    calibrated = emptyCostModel
+      { costLangs = Map.fromList
+        [ (CppLang, LangCost {costStartup = 1000000, costCall = 3, costByte = 1})
+        , (Python3Lang, LangCost {costStartup = 20000000, costCall = 100, costByte = 5})
+        ]
+      }
+    profiled = emptyCostModel
+      { costCalls = Map.fromList [((Python3Lang, "foo"), 5000000)] }
+
 typeAliasTests =
   testGroup
     "Test type alias substitutions"
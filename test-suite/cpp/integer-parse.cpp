@@ -0,0 +1,48 @@
+// Checks the bounds of the JSON integer parsers in serial.hpp. Each case is
+// parsed from the start of a string and must either fail or give the expected
+// value. Failing cases are printed and the exit status is non-zero.
+
+#define MORLOC_RUNTIME_IMPLEMENTATION
+#include "serial.hpp"
+
+static int failures = 0;
+
+template <class A>
+void accept(const std::string &json, A expected){
+    A x = 0;
+    size_t i = 0;
+    if(! deserialize(json, i, x) || x != expected){
+        std::cerr << "expected " << json << " to parse as " << expected << std::endl;
+        failures++;
+    }
+}
+
+template <class A>
+void reject(const std::string &json){
+    A x = 0;
+    size_t i = 0;
+    if(deserialize(json, i, x)){
+        std::cerr << "expected " << json << " to be rejected, got " << x << std::endl;
+        failures++;
+    }
+}
+
+int main(){
+    accept<int>("2147483647", 2147483647);
+    accept<int>("-2147483648", -2147483647 - 1);
+    reject<int>("2147483648");
+    reject<int>("-2147483649");
+    reject<int>("99999999999999999999");
+
+    accept<long>("9223372036854775807", 9223372036854775807L);
+    accept<long>("-9223372036854775808", -9223372036854775807L - 1);
+    reject<long>("9223372036854775808");
+
+    accept<size_t>("0", 0);
+    accept<size_t>("18446744073709551615", 18446744073709551615UL);
+    reject<size_t>("18446744073709551616");
+    reject<size_t>("-1");
+    reject<size_t>("-0");
+
+    return failures == 0 ? 0 : 1;
+}
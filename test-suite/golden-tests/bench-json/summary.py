@@ -0,0 +1,15 @@
+# Summarize the results of 'morloc bench'. Times differ between runs, so only
+# the calls, the fields and their consistency are printed.
+import json
+import sys
+
+with open(sys.argv[1]) as fh:
+    bench = json.load(fh)
+
+print("runs", bench["runs"], "warmup", bench["warmup"])
+for call in bench["calls"]:
+    latency = call["latency_ns"]
+    ordered = latency["min"] <= latency["p50"] <= latency["p90"] <= latency["p99"] <= latency["max"]
+    # the runs end to end take at least as long as the fastest run each
+    throughput = 0 < call["throughput_per_s"] <= 1e9 / latency["min"]
+    print(" ".join(call["call"]), sorted(latency), ordered, throughput, call["peak_rss_kb"] > 0)
@@ -0,0 +1,21 @@
+#ifndef __APPLY_H__
+#define __APPLY_H__
+
+#include <vector>
+
+// the function is a template parameter, so the call can be inlined
+template <class F, class A>
+std::vector<A> apply_all(F f, const std::vector<A> &xs){
+    std::vector<A> ys;
+    ys.reserve(xs.size());
+    for(const A &x : xs){
+        ys.push_back(f(x));
+    }
+    return ys;
+}
+
+double square(double x){
+    return x * x;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __COUNT_H__
+#define __COUNT_H__
+
+#include <vector>
+
+int count(std::vector<double> xs){
+    return xs.size();
+}
+
+#endif
@@ -0,0 +1,2 @@
+def ones(n):
+    return [1.0] * n
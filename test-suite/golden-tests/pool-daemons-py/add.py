@@ -0,0 +1,6 @@
+# every start of a pool that loads this module adds a line to starts.txt
+with open("starts.txt", "a") as fh:
+    print("python", file=fh)
+
+def add(x, y):
+    return x + y
@@ -0,0 +1,17 @@
+#ifndef __MUL_H__
+#define __MUL_H__
+
+#include <fstream>
+
+// every start of a pool that includes this header adds a line to starts.txt
+static bool record_start(){
+    std::ofstream("starts.txt", std::ios::app) << "cpp" << std::endl;
+    return true;
+}
+static bool started = record_start();
+
+double mul(double x, double y){
+    return x * y;
+}
+
+#endif
@@ -0,0 +1,9 @@
+def slow(x):
+    with open("calls.txt", "a") as fh:
+        print("slow", file=fh)
+    return x + 1
+
+def fast(x):
+    with open("calls.txt", "a") as fh:
+        print("fast", file=fh)
+    return x + 1
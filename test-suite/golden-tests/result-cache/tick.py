@@ -0,0 +1,4 @@
+def tick(x):
+    with open("calls.txt", "a") as fh:
+        print("called", file=fh)
+    return x
@@ -0,0 +1,24 @@
+# Summarize a trace written by the pools: the number of processes and traces,
+# and the kinds of events. Manifold ids change between builds, so manifolds
+# are listed by the sourced function they call.
+import json
+import sys
+
+with open(sys.argv[1]) as fh:
+    # the pools leave the event array open
+    events = json.loads(fh.read().rstrip().rstrip(",") + "]")
+
+pids = {e["pid"] for e in events}
+traces = {e["args"]["trace"] for e in events}
+print("events from {} processes in {} trace".format(len(pids), len(traces)))
+
+kinds = set()
+for e in events:
+    name = e["name"]
+    if e["cat"] == "manifold":
+        if " " not in name:
+            continue
+        name = name.split(" ", 1)[1]
+    kinds.add((e["cat"], name))
+for (cat, name) in sorted(kinds):
+    print(cat, name)